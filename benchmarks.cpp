@@ -0,0 +1,560 @@
+#include <iostream>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include "chessboard.h"
+#include "bitboard.h"
+#include "transposition.h"
+#include "evalkernels.h"
+
+using namespace std;
+
+namespace ChessBench
+{
+//Counts all heap allocations of the program, for the alloc benchmark
+atomic<uint64_t> allocationCount(0);
+}
+
+void* operator new(size_t size)
+{
+    ++ChessBench::allocationCount;
+    if(void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+namespace ChessBench
+{
+
+using namespace Chess;
+
+typedef chrono::steady_clock T_clock;
+
+double secondsSince(T_clock::time_point start)
+{
+    return chrono::duration<double>(T_clock::now() - start).count();
+}
+
+//Positions from ChessNotes.txt
+const char* notesPositions[] =
+{
+    "K4Q2/8/8/8/8/8/8/k7 w",
+    "R1B2R2/PPPKNb1P/2N2qP1/2B1P3/4p3/2n3p1/pppp1p1p/r1b1k1nr b",
+    "4q3/1P2N3/1PN1K3/P3P1b1/4p1BP/3p2p1/ppp1nk1p/r6r w",
+    "4q3/1P2N3/1P2K3/P3P1b1/1N2p1BP/3p2p1/ppp1nk1p/r6r b",
+    "4q3/1P2N3/1P2K3/P5b1/1N1Pp1BP/3p2p1/ppp2k1p/r6r b",
+    "2B1K2R/1RPQBPP1/P1P2N1P/3P4/p2pP3/2n1p1q1/1ppknppp/r1b1r3 w",
+    "2B2RK1/1RPQBPP1/P1P2N1P/3P4/p2pP3/2n1p1q1/1ppknppp/r1b1r3 b",
+    "r1B2RK1/1R2QPP1/5N1P/3P4/1P1pP3/4p1qp/2pknpp1/4r3 b",
+    "1rB1R1K1/5P2/2R2N1P/3P2P1/1Q1pP3/1pn1p2p/3k1ppq/2r5 w",
+    "1r2R1K1/5P2/2pqBN1P/3P2P1/2QpP3/2n1p2p/2rk1pp1/8 b",
+    "QR3K2/5P2/2p1B2r/1r4q1/8/2nPP2p/1k4p1/8 b",
+};
+
+struct SliderSquares
+{
+    T_bitboard occupied;
+    T_bitboard rooks;   //Rooks and queens
+    T_bitboard bishops; //Bishops and queens
+};
+
+//Reads the piece placement part of a FEN string, in the board layout Field uses.
+SliderSquares parseSliderSquares(const char* fen)
+{
+    SliderSquares ret = {0, 0, 0};
+    int pos = 0;
+    for(const char* c = fen; *c && *c != ' ' && pos < 64; ++c)
+    {
+        if(*c == '/')
+            continue;
+        if(isdigit(*c))
+        {
+            pos += *c - '0';
+            continue;
+        }
+        char p = tolower(*c);
+        if(p == 'r' || p == 'q')
+            ret.rooks |= bit(pos);
+        if(p == 'b' || p == 'q')
+            ret.bishops |= bit(pos);
+        ret.occupied |= bit(pos++);
+    }
+    return ret;
+}
+
+//Reads the piece placement part of a FEN string into a board array, as Field has it
+vector<Piece> parsePieces(const char* fen)
+{
+    const string kinds = "prnbqk";
+    const Piece::Enum pieceOf[] = { Piece::pawn, Piece::rook, Piece::knight, Piece::bishop, Piece::queen, Piece::king };
+    vector<Piece> ret(64, Piece(false));
+    int pos = 0;
+    for(const char* c = fen; *c && *c != ' ' && pos < 64; ++c)
+    {
+        if(*c == '/')
+            continue;
+        if(isdigit(*c))
+        {
+            pos += *c - '0';
+            continue;
+        }
+        size_t kind = kinds.find((char)tolower(*c));
+        if(kind != string::npos)
+            ret[pos] = Piece(isupper(*c) != 0, pieceOf[kind]);
+        ++pos;
+    }
+    return ret;
+}
+
+template<class T_rook, class T_bishop>
+double timeSliders(const vector<SliderSquares>& positions, int rounds, T_rook rook, T_bishop bishop,
+                   T_bitboard& checksum, long long& lookups)
+{
+    auto start = T_clock::now();
+    for(int r = 0; r < rounds; ++r)
+        for(auto &p:positions)
+        {
+            for(T_bitboard b = p.rooks; b; ++lookups)
+                checksum ^= rook(popLsb(b), p.occupied);
+            for(T_bitboard b = p.bishops; b; ++lookups)
+                checksum ^= bishop(popLsb(b), p.occupied);
+        }
+    return secondsSince(start);
+}
+
+//Compares the sliding attack lookup tables with walking the rays square by square
+void benchSliders(istream& params)
+{
+    int rounds = -1;
+    params >> rounds;
+    if(rounds <= 0)
+        rounds = 100000;
+
+    vector<SliderSquares> positions;
+    for(auto fen:notesPositions)
+        positions.push_back(parseSliderSquares(fen));
+
+    for(auto &p:positions)
+    {
+        for(T_bitboard b = p.rooks; b; )
+        {
+            int ix = popLsb(b);
+            if(rookAttacks(ix, p.occupied) != rookAttacksByRays(ix, p.occupied))
+                throw runtime_error("Rook attack table differs from ray walker");
+        }
+        for(T_bitboard b = p.bishops; b; )
+        {
+            int ix = popLsb(b);
+            if(bishopAttacks(ix, p.occupied) != bishopAttacksByRays(ix, p.occupied))
+                throw runtime_error("Bishop attack table differs from ray walker");
+        }
+    }
+
+    T_bitboard checksumRays = 0, checksumTable = 0;
+    long long lookupsRays = 0, lookupsTable = 0;
+    double secRays  = timeSliders(positions, rounds, rookAttacksByRays, bishopAttacksByRays, checksumRays, lookupsRays);
+    double secTable = timeSliders(positions, rounds, rookAttacks, bishopAttacks, checksumTable, lookupsTable);
+    if(checksumRays != checksumTable)
+        throw runtime_error("Checksum of attack table differs from ray walker");
+
+#ifdef CHESS_USE_PEXT
+    const char* tableName = "pext table";
+#else
+    const char* tableName = "magic table";
+#endif
+    cout << fixed << setprecision(1)
+         << positions.size() << " positions, " << rounds << " rounds, " << lookupsTable << " lookups each" << endl
+         << setw(12) << left << "ray walker" << lookupsRays  / secRays  / 1e6 << " Mlookups/s" << endl
+         << setw(12) << left << tableName    << lookupsTable / secTable / 1e6 << " Mlookups/s" << endl
+         << "Speedup: " << setprecision(2) << secRays / secTable << "x" << endl;
+    cout.unsetf(ios::floatfield);
+}
+
+// Reference positions for perft. The well known ones are from
+// http://chessprogramming.wikispaces.com/Perft+Results, written in the FEN
+// layout of this board (first rank first). Node counts follow the rules of this
+// engine: no castling, en passant or promotion, and a game ends when a king is
+// captured. That is why they only match the published numbers for a few plies.
+struct PerftPosition
+{
+    const char* name;
+    const char* fen;
+    uint64_t    nodes[5]; //Expected leaf nodes for depth 1..5
+};
+
+const PerftPosition perftPositions[] =
+{
+    {"initial",   "RNBQKBNR/PPPPPPPP/8/8/8/8/pppppppp/rnbqkbnr w",
+        {20, 400, 8902, 197281, 4865351}},
+    {"kiwipete",  "R3K2R/PPPBBPPP/2N2Q1p/1p2P3/3PN3/bn2pnp1/p1ppqpb1/r3k2r w",
+        {46, 1865, 86585, 3488552, 161185928}},
+    {"position3", "8/4P1P1/8/1R3p1k/KP5r/3p4/2p5/8 w",
+        {14, 191, 2810, 43087, 671300}},
+    {"position4", "R2Q1RK1/Pp1P2PP/q4N2/BBP1P3/nP6/1b3nbN/Pppp1ppp/r3k2r w",
+        {6, 222, 7861, 302707, 11215898}},
+    {"position5", "RNBQK2R/PPP1NnPP/8/2B5/8/2p5/pp1Pbppp/rnbq1k1r w",
+        {40, 1349, 51751, 1758865, 68848584}},
+    {"notes1",    "4q3/1P2N3/1PN1K3/P3P1b1/4p1BP/3p2p1/ppp1nk1p/r6r w",
+        {15, 736, 10375, 479601, 7585418}},
+    {"notes2",    "QR3K2/5P2/2p1B2r/1r4q1/8/2nPP2p/1k4p1/8 b",
+        {41, 1000, 36436, 933847, 34549932}},
+};
+
+//Runs perft on all reference positions, checks the node counts and reports the speed
+void benchPerft(istream& params)
+{
+    int maxDepth = -1;
+    params >> maxDepth;
+    if(maxDepth <= 0)
+        maxDepth = 4;
+    if(maxDepth > 5)
+        throw runtime_error("No reference node counts above depth 5");
+
+    PChessBoard board = makeChessBoard();
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0;
+    int failures = 0;
+    for(auto &p:perftPositions)
+    {
+        board->fen(p.fen);
+        auto start = T_clock::now();
+        uint64_t nodes = board->perft(maxDepth);
+        double seconds = secondsSince(start);
+        uint64_t expected = p.nodes[maxDepth - 1];
+        totalNodes += nodes;
+        totalSeconds += seconds;
+        cout << setw(10) << left << p.name << setw(12) << right << nodes << "  "
+             << fixed << setprecision(3) << seconds << " s  "
+             << setprecision(0) << setw(12) << nodes / max(seconds, 1e-9) << " nodes/s";
+        if(nodes != expected)
+        {
+            ++failures;
+            cout << "  FAILED, expected " << expected;
+        }
+        cout << endl;
+    }
+    cout << setw(10) << left << "total" << setw(12) << right << totalNodes << "  "
+         << setprecision(3) << totalSeconds << " s  "
+         << setprecision(0) << setw(12) << totalNodes / max(totalSeconds, 1e-9) << " nodes/s" << endl;
+    cout.unsetf(ios::floatfield);
+    if(failures > 0)
+        throw runtime_error("Perft node count mismatch");
+}
+
+//Probes and stores random keys in a shared transposition table from 1, 2, 4... threads
+void benchTranspositionTable(istream& params)
+{
+    int maxThreads = -1;
+    params >> maxThreads;
+    if(maxThreads <= 0)
+        maxThreads = max(1u, thread::hardware_concurrency());
+    const int opsPerThread = 4000000;
+
+    TranspositionTable tt(64);
+    cout << "64 MB table, " << opsPerThread << " probes per thread, stores on miss" << endl;
+    for(int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+    {
+        tt.clear();
+        atomic<long long> hits(0);
+        vector<thread> threads;
+        auto start = T_clock::now();
+        for(int t = 0; t < threadCount; ++t)
+            threads.emplace_back([&, t]
+            {
+                T_hash rnd = 0x9E3779B97F4A7C15ULL * (t + 1);
+                long long threadHits = 0;
+                for(int i = 0; i < opsPerThread; ++i)
+                {
+                    rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+                    T_hash key = (rnd & 0xFFFFF) * 0x9E3779B97F4A7C15ULL; //1M distinct keys
+                    TranspositionTable::Entry entry;
+                    if(tt.probe(key, entry))
+                        ++threadHits;
+                    else
+                        tt.store(key, (int)i, i & 0x3F, TranspositionTable::boundExact, PackedMove());
+                }
+                hits += threadHits;
+            });
+        for(auto &t:threads)
+            t.join();
+        double seconds = secondsSince(start);
+        double ops = double(opsPerThread) * threadCount;
+        cout << setw(3) << right << threadCount << " threads: " << fixed << setprecision(1)
+             << setw(7) << ops / seconds / 1e6 << " Mprobes/s, "
+             << setw(6) << ops / seconds / 1e6 / threadCount << " per thread, "
+             << setw(5) << 100.0 * hits / ops << "% hits" << endl;
+    }
+    cout.unsetf(ios::floatfield);
+}
+
+//Time to depth and nodes/s of think with 1, 2, 4... threads, for both parallel modes
+void benchThreads(istream& params)
+{
+    int depth = -1;
+    int maxThreads = -1;
+    params >> depth >> maxThreads;
+    if(depth <= 0)
+        depth = 5;
+    if(maxThreads <= 0)
+        maxThreads = 32;
+
+    const char* positions[] = { notesPositions[2], notesPositions[5], notesPositions[10] };
+    cout << "Depth " << depth << ", " << sizeof(positions) / sizeof(*positions) << " positions from ChessNotes.txt, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    const char* modes[] = { "lazy smp", "ybwc" };
+    for(int ybwc = 0; ybwc < 2; ++ybwc)
+    {
+        double baseSeconds = 0;
+        for(int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+        {
+            uint64_t nodes = 0;
+            double seconds = 0;
+            for(auto fen:positions)
+            {
+                PChessBoard board = makeChessBoard();
+                board->setOption("Threads", threadCount);
+                board->setOption("YBWC", ybwc);
+                board->fen(fen);
+                auto start = T_clock::now();
+                board->think([](Move, int, int){}, depth);
+                seconds += secondsSince(start);
+                nodes += board->searchStats().nodes;
+            }
+            if(threadCount == 1)
+                baseSeconds = seconds;
+            cout << setw(8) << left << modes[ybwc] << setw(3) << right << threadCount << " threads: " << fixed
+                 << setprecision(3) << setw(8) << seconds << " s to depth, "
+                 << setprecision(0) << setw(10) << nodes / max(seconds, 1e-9) << " nodes/s, "
+                 << setprecision(2) << setw(5) << baseSeconds / max(seconds, 1e-9) << "x speedup" << endl;
+        }
+    }
+    cout.unsetf(ios::floatfield);
+}
+
+//Think with parts of the selective search switched off, to see what each one gains.
+//Also counts how often the best move differs from the full width search.
+void benchSelective(istream& params)
+{
+    int depth = -1;
+    params >> depth;
+    if(depth <= 0)
+        depth = 5;
+
+    struct Config
+    {
+        const char* name;
+        int nullMove, lmr, futility, see;
+    };
+    const Config configs[] = {
+        { "full width",   0, 0, 0, 0 },
+        { "all",          1, 1, 1, 1 },
+        { "no null move", 0, 1, 1, 1 },
+        { "no lmr",       1, 0, 1, 1 },
+        { "no futility",  1, 1, 0, 1 },
+        { "no see",       1, 1, 1, 0 }
+    };
+
+    cout << "Depth " << depth << ", " << sizeof(notesPositions) / sizeof(*notesPositions)
+         << " positions from ChessNotes.txt" << endl;
+    vector<Move> fullWidthMoves;
+    for(auto &c:configs)
+    {
+        uint64_t nodes = 0;
+        double seconds = 0;
+        int differentMoves = 0;
+        for(size_t i = 0; i < sizeof(notesPositions) / sizeof(*notesPositions); ++i)
+        {
+            PChessBoard board = makeChessBoard();
+            board->setOption("NullMove", c.nullMove);
+            board->setOption("LMR", c.lmr);
+            board->setOption("Futility", c.futility);
+            board->setOption("SEE", c.see);
+            board->fen(notesPositions[i]);
+            Move best;
+            auto start = T_clock::now();
+            board->think([&](Move m, int, int){ best = m; }, depth);
+            seconds += secondsSince(start);
+            nodes += board->searchStats().nodes;
+            if(fullWidthMoves.size() <= i)
+                fullWidthMoves.push_back(best);
+            else if(!(best.from == fullWidthMoves[i].from && best.to == fullWidthMoves[i].to))
+                ++differentMoves;
+        }
+        cout << setw(13) << left << c.name << fixed << setprecision(3) << setw(8) << right << seconds << " s, "
+             << setw(10) << nodes << " nodes, " << setw(2) << differentMoves << " other best moves" << endl;
+    }
+    cout.unsetf(ios::floatfield);
+}
+
+//Static evaluations per second with each set of evaluation kernels the CPU supports
+void benchEval(istream& params)
+{
+    int rounds = -1;
+    params >> rounds;
+    if(rounds <= 0)
+        rounds = 100000;
+
+    const int positionCount = sizeof(notesPositions) / sizeof(*notesPositions);
+    vector<vector<Piece>> boards;
+    for(auto fen:notesPositions)
+        boards.push_back(parsePieces(fen));
+
+    cout << rounds << " rounds over " << positionCount << " positions from ChessNotes.txt" << endl;
+    const EvalKernels* defaultKernels = evalKernels;
+    int reference = 0;
+    for(auto kernels:supportedEvalKernels())
+    {
+        evalKernels = kernels;
+        vector<PChessBoard> positions;
+        for(auto fen:notesPositions)
+        {
+            positions.push_back(makeChessBoard());
+            positions.back()->fen(fen);
+        }
+
+        int checksum = 0;
+        auto start = T_clock::now();
+        for(int r = 0; r < rounds; ++r)
+            for(auto &board:positions)
+                checksum += board->evaluate();
+        double evalSeconds = secondsSince(start);
+
+        start = T_clock::now();
+        for(int r = 0; r < rounds; ++r)
+            for(auto &board:boards)
+                checksum += kernels->pieceSquareSum(board.data(), evalWeights.pieceSquare[r & 1]);
+        double sumSeconds = secondsSince(start);
+
+        if(kernels == supportedEvalKernels().front())
+            reference = checksum;
+        double count = double(rounds) * positionCount;
+        cout << setw(8) << left << kernels->name << right << fixed << setprecision(2)
+             << setw(7) << count / evalSeconds / 1e6 << " M evals/s, "
+             << setw(7) << count / sumSeconds / 1e6 << " M piece-square sums/s"
+             << (checksum == reference ? "" : ", scores differ from scalar!") << endl;
+    }
+    evalKernels = defaultKernels;
+    cout.unsetf(ios::floatfield);
+}
+
+//Heap allocations done by move generation, perft and think
+void benchAllocations(istream& params)
+{
+    int depth = -1;
+    params >> depth;
+    if(depth <= 0)
+        depth = 4;
+
+    PChessBoard board = makeChessBoard();
+    board->fen(notesPositions[5]);
+
+    auto report = [](const char* what, uint64_t allocations, uint64_t calls)
+    {
+        cout << setw(28) << left << what << setw(10) << right << allocations << " allocations";
+        if(calls > 1)
+            cout << ", " << fixed << setprecision(2) << double(allocations) / calls << " per call";
+        cout << endl;
+        cout.unsetf(ios::floatfield);
+    };
+
+    const int calls = 10000;
+    uint64_t start = allocationCount;
+    for(int i = 0; i < calls; ++i)
+        board->getMoves();
+    report("getMoves()", allocationCount - start, calls);
+
+    MoveList moves;
+    start = allocationCount;
+    for(int i = 0; i < calls; ++i)
+        board->getMoves(moves);
+    report("getMoves(MoveList&)", allocationCount - start, calls);
+
+    start = allocationCount;
+    for(int i = 0; i < calls; ++i)
+    {
+        board->move(moves[i % moves.size()]);
+        board->undo();
+    }
+    report("move + undo", allocationCount - start, calls);
+
+    start = allocationCount;
+    uint64_t nodes = board->perft(depth);
+    report("perft", allocationCount - start, nodes);
+
+    start = allocationCount;
+    board->think([](Move, int, int){}, depth);
+    report("think (incl. progress calls)", allocationCount - start, board->searchStats().nodes);
+}
+
+struct Benchmark
+{
+    string name;
+    string description;
+    function<void(istream& params)> run;
+};
+
+void bench(istream& params)
+{
+    Benchmark benchmarks[] = {
+        {
+            "sliders",
+            "[rounds] Sliding attack tables vs ray walking on the ChessNotes positions",
+            benchSliders
+        },
+        {
+            "perft",
+            "[depth] Perft on reference positions, checks node counts and reports nodes/s",
+            benchPerft
+        },
+        {
+            "tt",
+            "[threads] Shared transposition table throughput with 1, 2, 4... threads",
+            benchTranspositionTable
+        },
+        {
+            "threads",
+            "[depth] [max threads] Think scaling with 1, 2, 4... threads, Lazy SMP and YBWC",
+            benchThreads
+        },
+        {
+            "selective",
+            "[depth] Think with and without null move, LMR, futility and SEE pruning",
+            benchSelective
+        },
+        {
+            "eval",
+            "[rounds] Evaluations/s with the scalar, SSE2 and AVX2 evaluation kernels",
+            benchEval
+        },
+        {
+            "alloc",
+            "[depth] Count heap allocations of move generation, perft and think",
+            benchAllocations
+        }
+    };
+
+    string name;
+    params >> name;
+    for(auto &i:benchmarks)
+        if(name == i.name)
+        {
+            i.run(params);
+            return;
+        }
+    cout << "Available benchmarks:" << endl;
+    for(auto &i:benchmarks)
+        cout << setw(10) << left << i.name << setw(0) << i.description << endl;
+}
+
+}//namespace ChessBench
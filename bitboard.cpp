@@ -0,0 +1,198 @@
+#include "bitboard.h"
+#include <cstddef>
+
+namespace Chess
+{
+
+T_bitboard knightAttacks[64];
+T_bitboard kingAttacks[64];
+T_bitboard pawnAttacks[2][64];
+T_bitboard squaresBetween[64][64];
+T_bitboard lineThrough[64][64];
+
+Magic rookMagics[64];
+Magic bishopMagics[64];
+
+namespace
+{
+
+const int rookDirs[][2]   = {{1,0},{-1,0},{0,1},{0,-1}};
+const int bishopDirs[][2] = {{1,1},{-1,1},{1,-1},{-1,-1}};
+
+//Sizes are the sum of 2^(mask bits) over all squares
+T_bitboard rookTable[0x19000];
+T_bitboard bishopTable[0x1480];
+
+T_bitboard attacksByRays(int ix, T_bitboard occupied, const int (*dirs)[2])
+{
+    T_bitboard ret = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        int x = ix % 8;
+        int y = ix / 8;
+        while(true)
+        {
+            x += dirs[i][0];
+            y += dirs[i][1];
+            if(x < 0 || x >= 8 || y < 0 || y >= 8)
+                break;
+            ret |= bit(x + y * 8);
+            if(occupied & bit(x + y * 8))
+                break;
+        }
+    }
+    return ret;
+}
+
+//Squares that can block a slider. The last square of a ray never blocks anything behind it.
+T_bitboard relevantMask(int ix, const int (*dirs)[2])
+{
+    T_bitboard ret = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        int x = ix % 8 + dirs[i][0];
+        int y = ix / 8 + dirs[i][1];
+        while(x + dirs[i][0] >= 0 && x + dirs[i][0] < 8 && y + dirs[i][1] >= 0 && y + dirs[i][1] < 8)
+        {
+            ret |= bit(x + y * 8);
+            x += dirs[i][0];
+            y += dirs[i][1];
+        }
+    }
+    return ret;
+}
+
+//Fixed seed, so the same magics are found each run.
+struct Rng
+{
+    T_bitboard s = 0x9E3779B97F4A7C15ULL;
+    T_bitboard next()
+    {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return s * 2685821657736338717ULL;
+    }
+    T_bitboard sparse() { return next() & next() & next(); }
+};
+
+//Fills magics and attack table for all squares
+void initMagics(Magic* magics, T_bitboard* table, const int (*dirs)[2])
+{
+    Rng rng;
+    T_bitboard occupancy[4096];
+    T_bitboard reference[4096];
+    int        epoch[4096] = {0};
+    int        attempt = 0;
+    size_t     offset = 0;
+
+    for(int ix = 0; ix < 64; ++ix)
+    {
+        Magic& m = magics[ix];
+        m.mask = relevantMask(ix, dirs);
+        int bits = popCount(m.mask);
+        m.shift = 64 - bits;
+        m.attacks = table + offset;
+        m.magic = 0;
+
+        //Enumerate all subsets of the mask (Carry-Rippler)
+        int size = 0;
+        T_bitboard occ = 0;
+        do
+        {
+            occupancy[size] = occ;
+            reference[size] = attacksByRays(ix, occ, dirs);
+            ++size;
+            occ = (occ - m.mask) & m.mask;
+        } while(occ);
+        offset += size;
+
+#ifdef CHESS_USE_PEXT
+        for(int i = 0; i < size; ++i)
+            m.attacks[m.index(occupancy[i])] = reference[i];
+#else
+        //Search for a magic without destructive collisions
+        bool found = false;
+        while(!found)
+        {
+            do
+                m.magic = rng.sparse();
+            while(popCount((m.mask * m.magic) >> 56) < 6);
+
+            ++attempt;
+            found = true;
+            for(int i = 0; i < size; ++i)
+            {
+                unsigned idx = m.index(occupancy[i]);
+                if(epoch[idx] < attempt)
+                {
+                    epoch[idx] = attempt;
+                    m.attacks[idx] = reference[i];
+                }
+                else if(m.attacks[idx] != reference[i])
+                {
+                    found = false;
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+T_bitboard leaperAttacks(int ix, const int (*deltas)[2], int count)
+{
+    int x = ix % 8;
+    int y = ix / 8;
+    T_bitboard ret = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        int tx = x + deltas[i][0];
+        int ty = y + deltas[i][1];
+        if(tx >= 0 && tx < 8 && ty >= 0 && ty < 8)
+            ret |= bit(tx + ty * 8);
+    }
+    return ret;
+}
+
+//Initialize attack tables during static init time
+const bool attackTablesInitialized = []
+{
+    const int knightDeltas[][2] = {{1,2},{-1,2},{1,-2},{-1,-2},{2,1},{2,-1},{-2,1},{-2,-1}};
+    const int kingDeltas[][2]   = {{0,1},{1,1},{1,0},{1,-1},{0,-1},{-1,-1},{-1,0},{-1,1}};
+    const int whitePawnDeltas[][2] = {{-1,1},{1,1}};
+    const int blackPawnDeltas[][2] = {{-1,-1},{1,-1}};
+
+    for(int ix = 0; ix < 64; ++ix)
+    {
+        knightAttacks[ix]   = leaperAttacks(ix, knightDeltas, 8);
+        kingAttacks[ix]     = leaperAttacks(ix, kingDeltas, 8);
+        pawnAttacks[1][ix]  = leaperAttacks(ix, whitePawnDeltas, 2);
+        pawnAttacks[0][ix]  = leaperAttacks(ix, blackPawnDeltas, 2);
+    }
+    initMagics(rookMagics,   rookTable,   rookDirs);
+    initMagics(bishopMagics, bishopTable, bishopDirs);
+
+    const int (*sliderDirs[])[2] = { rookDirs, bishopDirs };
+    for(int from = 0; from < 64; ++from)
+        for(int to = 0; to < 64; ++to)
+            for(auto dirs:sliderDirs)
+                if(from != to && (attacksByRays(from, 0, dirs) & bit(to)))
+                {
+                    squaresBetween[from][to] = attacksByRays(from, bit(to), dirs) & attacksByRays(to, bit(from), dirs);
+                    lineThrough[from][to] = (attacksByRays(from, 0, dirs) & attacksByRays(to, 0, dirs)) | bit(from) | bit(to);
+                }
+    return true;
+}();
+
+}
+
+T_bitboard rookAttacksByRays(int ix, T_bitboard occupied)
+{
+    return attacksByRays(ix, occupied, rookDirs);
+}
+
+T_bitboard bishopAttacksByRays(int ix, T_bitboard occupied)
+{
+    return attacksByRays(ix, occupied, bishopDirs);
+}
+
+}//namespace Chess
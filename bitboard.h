@@ -0,0 +1,130 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef CHESS_USE_PEXT
+#include <immintrin.h>
+#endif
+
+namespace Chess
+{
+
+// One bit per square, using the same index as Field: x + y * 8.
+// http://chessprogramming.wikispaces.com/Bitboards
+typedef uint64_t T_bitboard;
+
+inline T_bitboard bit(int ix) { return T_bitboard(1) << ix; }
+
+inline int popCount(T_bitboard b)
+{
+#ifdef _MSC_VER
+    return (int)__popcnt64(b);
+#else
+    return __builtin_popcountll(b);
+#endif
+}
+
+//Index of least significant set bit. b must not be 0.
+inline int bitScan(T_bitboard b)
+{
+#ifdef _MSC_VER
+    unsigned long ix;
+    _BitScanForward64(&ix, b);
+    return (int)ix;
+#else
+    return __builtin_ctzll(b);
+#endif
+}
+
+//Returns index of least significant set bit and clears it.
+inline int popLsb(T_bitboard& b)
+{
+    int ix = bitScan(b);
+    b &= b - 1;
+    return ix;
+}
+
+const T_bitboard FILE_A = 0x0101010101010101ULL;
+const T_bitboard FILE_H = FILE_A << 7;
+
+inline T_bitboard fileOf(int ix) { return FILE_A << (ix & 7); }
+
+//Files left and right of square ix
+inline T_bitboard adjacentFiles(int ix)
+{
+    T_bitboard file = fileOf(ix);
+    return ((file & ~FILE_A) >> 1) | ((file & ~FILE_H) << 1);
+}
+
+//All squares on the ranks in front of square ix, seen from color (true == white)
+inline T_bitboard forwardRanks(bool color, int ix)
+{
+    int rank = ix >> 3;
+    if(color)
+        return rank == 7 ? 0 : ~T_bitboard(0) << ((rank + 1) * 8);
+    return rank == 0 ? 0 : ~T_bitboard(0) >> ((8 - rank) * 8);
+}
+
+extern T_bitboard knightAttacks[64];
+extern T_bitboard kingAttacks[64];
+extern T_bitboard pawnAttacks[2][64]; //[color][square], color true == white
+
+//Squares strictly between two squares on a rank, file or diagonal, 0 if they are not on one
+extern T_bitboard squaresBetween[64][64];
+//The whole rank, file or diagonal through two squares, 0 if they are not on one
+extern T_bitboard lineThrough[64][64];
+
+// Sliding piece attacks are looked up in precomputed tables, indexed by the
+// occupancy of the squares that can block the slider.
+// http://chessprogramming.wikispaces.com/Magic+Bitboards
+// When built with CHESS_USE_PEXT the index is computed with the BMI2 PEXT
+// instruction instead of a magic multiplication.
+struct Magic
+{
+    T_bitboard  mask;    //Relevant occupancy, excluding the board edge
+    T_bitboard  magic;
+    T_bitboard* attacks; //Points into the shared attack table
+    int         shift;
+
+    inline unsigned index(T_bitboard occupied) const
+    {
+#ifdef CHESS_USE_PEXT
+        return (unsigned)_pext_u64(occupied, mask);
+#else
+        return (unsigned)(((occupied & mask) * magic) >> shift);
+#endif
+    }
+};
+
+extern Magic rookMagics[64];
+extern Magic bishopMagics[64];
+
+//Squares attacked by a slider on ix, including the first blocker in each direction.
+inline T_bitboard rookAttacks(int ix, T_bitboard occupied)
+{
+    const Magic& m = rookMagics[ix];
+    return m.attacks[m.index(occupied)];
+}
+
+inline T_bitboard bishopAttacks(int ix, T_bitboard occupied)
+{
+    const Magic& m = bishopMagics[ix];
+    return m.attacks[m.index(occupied)];
+}
+
+inline T_bitboard queenAttacks(int ix, T_bitboard occupied)
+{
+    return rookAttacks(ix, occupied) | bishopAttacks(ix, occupied);
+}
+
+//Same as above, but calculated by walking each ray one square at a time.
+//Used to fill the lookup tables and as a reference.
+T_bitboard rookAttacksByRays(int ix, T_bitboard occupied);
+T_bitboard bishopAttacksByRays(int ix, T_bitboard occupied);
+
+}
+
+#endif // BITBOARD_H
@@ -1,10 +1,22 @@
 #include "chessboard.h"
+#include "bitboard.h"
+#include "transposition.h"
+#include "evalcache.h"
+#include "pawntable.h"
+#include "evalweights.h"
+#include "evalkernels.h"
+#include "threadpool.h"
 #include <string.h>
 #include <sstream>
 #include <algorithm>
 #include <random>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 using namespace std;
+using namespace std::chrono;
 
 
 
@@ -19,7 +31,42 @@ const int WIDTH = 8;
 const int HEIGHT = 8;
 const int POSITIONS = WIDTH * HEIGHT;
 
-const int WINDOWMAX = 0x7FFFFFFF / 2;
+const int WINDOWMAX = MATE_SCORE;
+
+//Nodes with less remaining depth are not worth the overhead of splitting
+const int SPLIT_MIN_DEPTH = 3;
+
+//Cheapest first
+const Piece::Enum PIECES_BY_VALUE[] = { Piece::pawn, Piece::knight, Piece::bishop, Piece::rook, Piece::queen, Piece::king };
+
+const T_bitboard RANK_3 = 0x0000000000FF0000ULL;
+const T_bitboard RANK_6 = 0x0000FF0000000000ULL;
+
+//Deepest ply that has killer moves
+const int MAX_PLY = 128;
+//Deepest iteration when SearchLimits has no depth, leaves room for the quiescence search below MAX_PLY
+const int MAX_DEPTH = 64;
+
+//Time management, see SearchControl
+const int NODE_BATCH = 1024;         //Nodes a thread counts before it adds them to the total and checks the clock
+const int DEFAULT_MOVES_TO_GO = 30;  //Expected moves left when the clock is for the rest of the game
+const int TIME_MARGIN = 50;          //ms kept on the clock for the communication with the GUI
+
+//Positional gain a capture in the quiescence search may have on top of the
+//captured material, about two pawns. Captures that can't reach alpha even
+//with it are skipped.
+const int DELTA_MARGIN = 20;
+
+//Half the width of the root window around the score of the previous iteration
+const int ASPIRATION_WINDOW = 30;
+
+//Selective search, see Field::score
+const int NULL_MOVE_MIN_DEPTH = 3;
+const int LMR_MIN_DEPTH = 3;
+const int LMR_MIN_MOVES = 3;                    //Moves searched before reducing
+const int FUTILITY_MARGIN[] = { 0, 30, 60 };    //By remaining depth
+const int RAZOR_MARGIN = 40;
+const int SEE_PRUNE_DEPTH = 2;                  //Losing captures are not searched up to this depth
 
 const int AsciiPieceWidth = 5;
 const int AsciiPieceHeight = 3;
@@ -35,7 +82,8 @@ const char* AsciiPieces =
 
 
 // http://en.wikipedia.org/wiki/Zobrist_hashing
-T_hash randomHashTable[POSITIONS][Piece::king*2];
+T_hash randomHashTable[POSITIONS][Piece::king*2 + 2];
+T_hash blackTurnHash; //Hashed in when it is blacks turn
 
 extern const T_hash clearHashVal;
 
@@ -79,11 +127,18 @@ istream& operator >>(istream& is, Move& m)
 }
 
 struct thinkCtxt;
+struct SplitPoint;
+struct SearchHeuristics;
 
 struct Field
 {
-    Field():turn(true),hashVal(clearHashVal)
-    { memset(pieces,0,sizeof(pieces)); }
+    Field():hashVal(clearHashVal),pawnHashVal(0),gamePhase(0),turn(true)
+    {
+        psqScore[middleGame] = psqScore[endGame] = 0;
+        memset(pieces,0,sizeof(pieces));
+        memset(pieceBB,0,sizeof(pieceBB));
+        memset(colorBB,0,sizeof(colorBB));
+    }
 
     static inline int toIx(Pos p) { return p.x + p.y * WIDTH; }
     static inline Pos toPos(int ix) { return Pos(ix%WIDTH, ix/WIDTH); }
@@ -91,6 +146,38 @@ struct Field
     inline Piece get(Pos pos) const { return pieces[toIx(pos)]; }
     inline void  set(Pos pos, Piece p) { pieces[toIx(pos)] = p; }
 
+    //**** Bitboards
+    inline T_bitboard occupied() const { return colorBB[0] | colorBB[1]; }
+    inline T_bitboard piecesOf(bool color, Piece::Enum p) const { return pieceBB[p] & colorBB[color]; }
+
+    //Toggles piece p on square ix in the bitboards. Does not touch pieces[].
+    inline void toggleBB(int ix, Piece p)
+    {
+        if(p.isEmpty())
+            return;
+        pieceBB[p.piece()] ^= bit(ix);
+        colorBB[p.color()] ^= bit(ix);
+    }
+
+    void resetBitboards()
+    {
+        memset(pieceBB,0,sizeof(pieceBB));
+        memset(colorBB,0,sizeof(colorBB));
+        for(int i=0; i<POSITIONS; ++i)
+            toggleBB(i,get(i));
+    }
+
+    //Material and piece-square score from whites view of both game phases,
+    //and the game phase itself. Kept up to date by makeMove.
+    void resetPsqScore()
+    {
+        psqScore[middleGame] = evalKernels->pieceSquareSum(pieces, evalWeights.pieceSquare[middleGame]);
+        psqScore[endGame] = evalKernels->pieceSquareSum(pieces, evalWeights.pieceSquare[endGame]);
+        gamePhase = 0;
+        for(int i=0; i<POSITIONS; ++i)
+            gamePhase += evalWeights.phase[get(i).piece()];
+    }
+
     bool isInside(Pos pos) const { return pos.x >= 0 && pos.x < WIDTH && pos.y >= 0 && pos.y < HEIGHT; }
 
     inline bool operator==(const Field& f) const
@@ -100,93 +187,147 @@ struct Field
         return memcmp(pieces,f.pieces,sizeof(pieces)) == 0;
     }
 
-    //*** Move
-    template<class T_moveCollector>
-    void getMoves(const T_moveCollector& moves) const
+    //*** Legality
+    //Square ix is attacked by a piece of byColor, with occ as occupied squares
+    inline bool isSquareAttacked(int ix, bool byColor, T_bitboard occ) const
     {
-        for(int i=0; i < POSITIONS; ++i)
-            if(!get(i).isEmpty())
-                if(!getMoves(moves, i))
-                    return;
+        return (attackersTo(ix, occ) & colorBB[byColor]) != 0;
     }
 
-    template<class T_moveCollector>
-    bool getMoves(const T_moveCollector& moves, Pos pos) const
+    inline bool isSquareAttacked(int ix, bool byColor) const
     {
-        return getMoves(moves, toIx(pos));
+        return isSquareAttacked(ix, byColor, occupied());
     }
 
-    inline int isOkMove(Move& m) const
+    //The king of the player who's turn it is is attacked
+    bool inCheck() const
     {
-        if(!isInside(m.to))
-            return 0;
-        m.pto = get(m.to);
-        if(m.pto.isEmpty())
-            return 1;
-        if(!m.pto.color() == !m.pfrom.color())
-            return 3;
-        return 2;
+        T_bitboard king = piecesOf(turn, Piece::king);
+        return king && isSquareAttacked(bitScan(king), !turn);
     }
 
-    template<class T_moveCollector>
-    inline bool addMove(const T_moveCollector& moves, Move& m, bool& stop) const
+    //What checks and pins allow the player who's turn it is.
+    //http://chessprogramming.wikispaces.com/Checks+and+Pinned+Pieces+%28Bitboards%29
+    struct Legality
     {
-        int ok = isOkMove(m);
-        if(ok == 0)
-            return false;
-        if(!moves(m))
-            stop = true;
-        return ok == 1;
+        int        king;     //Square of the own king, -1 if there is not exactly one
+        T_bitboard checkers; //Enemy pieces that give check
+        T_bitboard evasions; //Where pieces other than the king may go: anywhere, when in check
+                             //onto the checker or between it and the king, in double check nowhere
+        T_bitboard pinned;   //Own pieces that may only move along the line through them and the king
+    };
+
+    Legality legality() const
+    {
+        Legality l;
+        l.checkers = 0;
+        l.evasions = ~T_bitboard(0);
+        l.pinned = 0;
+        T_bitboard king = piecesOf(turn, Piece::king);
+        if(!king || (king & (king - 1)))
+        {
+            l.king = -1;
+            return l;
+        }
+        l.king = bitScan(king);
+        T_bitboard occ = occupied();
+        T_bitboard enemy = colorBB[!turn];
+        l.checkers = attackersTo(l.king, occ) & enemy;
+        if(l.checkers)
+            l.evasions = (l.checkers & (l.checkers - 1)) ? 0 : l.checkers | squaresBetween[l.king][bitScan(l.checkers)];
+        //Enemy sliders that would attack the king if one own piece was not in between
+        T_bitboard snipers = ((rookAttacks(l.king, 0) & (pieceBB[Piece::rook] | pieceBB[Piece::queen]))
+                            | (bishopAttacks(l.king, 0) & (pieceBB[Piece::bishop] | pieceBB[Piece::queen]))) & enemy;
+        while(snipers)
+        {
+            T_bitboard between = squaresBetween[l.king][popLsb(snipers)] & occ;
+            if(between && !(between & (between - 1)) && (between & colorBB[turn]))
+                l.pinned |= between;
+        }
+        return l;
     }
 
-    template<class T_moveCollector>
-    inline void addRookMoves(const T_moveCollector& moves, Move& m, bool& stop) const
+    //The part of targets the piece on square i may legally move to
+    inline T_bitboard legalTargets(int i, const Legality& l, T_bitboard targets) const
     {
-        for(int i = 0; i < 4; ++i)
+        if(i == l.king)
         {
-            m.to = m.from;
-            while(true)
+            //Without the king on its square, so it can't step back along the line of a slider
+            T_bitboard occ = occupied() ^ bit(i);
+            T_bitboard safe = 0;
+            for(T_bitboard b = kingAttacks[i] & targets & ~colorBB[turn]; b; )
             {
-                if(stop) return;
-                switch(i)
-                {
-                case 0: ++m.to.x; break;
-                case 1: --m.to.x; break;
-                case 2: ++m.to.y; break;
-                case 3: --m.to.y; break;
-                }
-                if(!addMove(moves,m,stop))
-                    break;
+                int to = popLsb(b);
+                if(!isSquareAttacked(to, !turn, occ))
+                    safe |= bit(to);
             }
+            return safe;
         }
+        targets &= l.evasions;
+        if(l.pinned & bit(i))
+            targets &= lineThrough[l.king][i];
+        return targets;
+    }
+
+    //*** Move
+    //Legal moves of the player who's turn it is
+    template<class T_moveCollector>
+    bool getTurnMoves(const T_moveCollector& moves) const
+    {
+        return getTurnMoves(moves, ~colorBB[turn]);
+    }
+
+    //Legal moves of the piece on pos, which must be of the player who's turn it is
+    template<class T_moveCollector>
+    bool getMoves(const T_moveCollector& moves, Pos pos) const
+    {
+        int ix = toIx(pos);
+        return getMoves(moves, ix, legalTargets(ix, legality(), ~colorBB[turn]));
     }
 
+    //Reports a move to every square in targets
     template<class T_moveCollector>
-    inline void addBishopMoves(const T_moveCollector& moves, Move& m, bool& stop) const
+    inline bool addMoves(const T_moveCollector& moves, Move& m, T_bitboard targets) const
     {
-        for(int i = 0; i < 4; ++i)
+        while(targets)
         {
-            m.to = m.from;
-            while(true)
-            {
-                if(stop) return;
-                switch(i)
-                {
-                case 0: ++m.to.x; ++m.to.y; break;
-                case 1: --m.to.x; ++m.to.y; break;
-                case 2: ++m.to.x; --m.to.y; break;
-                case 3: --m.to.x; --m.to.y; break;
-                }
-                if(!addMove(moves,m,stop))
-                    break;
-            }
+            int ix = popLsb(targets);
+            m.to = toPos(ix);
+            m.pto = pieces[ix];
+            if(!moves(m))
+                return false;
+        }
+        return true;
+    }
+
+    //Only legal moves to squares in targets. Pass colorBB[!turn] for captures or
+    //~occupied() for quiet moves.
+    template<class T_moveCollector>
+    bool getTurnMoves(const T_moveCollector& moves, T_bitboard targets) const
+    {
+        return getTurnMoves(moves, targets, legality());
+    }
+
+    template<class T_moveCollector>
+    bool getTurnMoves(const T_moveCollector& moves, T_bitboard targets, const Legality& l) const
+    {
+        T_bitboard own = colorBB[turn];
+        if(l.checkers & (l.checkers - 1))
+            own = bit(l.king); //Double check, only the king can move
+        for(T_bitboard b = own; b; )
+        {
+            int i = popLsb(b);
+            if(!getMoves(moves, i, legalTargets(i, l, targets)))
+                return false;
         }
+        return true;
     }
 
+    //Pseudo legal moves of the piece on square i to squares in targets,
+    //they may leave the own king attacked
     template<class T_moveCollector>
-    bool getMoves(const T_moveCollector& moves, int i) const
+    bool getMoves(const T_moveCollector& moves, int i, T_bitboard targets) const
     {
-        bool stop = false;
         Move m;
         m.from = toPos(i);
         m.pfrom = get(i);
@@ -196,93 +337,129 @@ struct Field
         case Piece::nothing: throw runtime_error("Unable to move this piece");
         case Piece::pawn:
         {
-            m.to = m.from;
-            m.to.y += m.pfrom.color() ? 1 : -1;
-            m.to.x -= 1;
-            if(isOkMove(m) == 2)
-                if(!moves(m)) return false;
-            m.to.x += 2;
-            if(isOkMove(m) == 2)
-                if(!moves(m)) return false;
-            m.to.x -= 1; //Orig pos
-            if(isOkMove(m) != 1)
-                break;
-            if(!moves(m)) return false;
-            if ((m.pfrom.color() && m.from.y != 1) || (!m.pfrom.color() && m.from.y != 6))
-                break; //Not able to do 2 moves forward
-            m.to.y += m.pfrom.color() ? 1 : -1;
-            if(isOkMove(m) != 1)
-                break;
-            if(!moves(m)) return false;
-        }
-        break;
-        case Piece::rook: addRookMoves(moves,m,stop); if(stop) return false; break;
-        case Piece::knight:
-        {
-            m.to = m.from;
-            //2 up
-            m.to.y += 2;
-            m.to.x += 1;
-            addMove(moves,m,stop);if(stop) return false;
-            m.to.x -= 2;
-            addMove(moves,m,stop);if(stop) return false;
-            //2 down
-            m.to.y -= 4;
-            addMove(moves,m,stop);if(stop) return false;
-            m.to.x += 2;
-            addMove(moves,m,stop);if(stop) return false;
-            //2 right
-            m.to.y += 1;
-            m.to.x += 1;
-            addMove(moves,m,stop);if(stop) return false;
-            m.to.y += 2;
-            addMove(moves,m,stop);if(stop) return false;
-            //2 left
-            m.to.x -= 4;
-            addMove(moves,m,stop);if(stop) return false;
-            m.to.y -= 2;
-            addMove(moves,m,stop);if(stop) return false;
-        }
-        break;
-        case Piece::bishop: addBishopMoves(moves,m,stop); if(stop)return false;break;
-        case Piece::queen:  addBishopMoves(moves,m,stop); if(stop)return false;
-                            addRookMoves  (moves,m,stop); if(stop)return false; break;
-        case Piece::king:
-        {
-            m.to = m.from;
-            ++m.to.y;
-            addMove(moves,m,stop);if(stop) return false;
-            ++m.to.x;
-            addMove(moves,m,stop);if(stop) return false;
-            --m.to.y;
-            addMove(moves,m,stop);if(stop) return false;
-            --m.to.y;
-            addMove(moves,m,stop);if(stop) return false;
-            --m.to.x;
-            addMove(moves,m,stop);if(stop) return false;
-            --m.to.x;
-            addMove(moves,m,stop);if(stop) return false;
-            ++m.to.y;
-            addMove(moves,m,stop);if(stop) return false;
-            ++m.to.y;
-            addMove(moves,m,stop);if(stop) return false;
+            bool white = m.pfrom.color();
+            if(!addMoves(moves, m, pawnAttacks[white][i] & colorBB[!white] & targets))
+                return false;
+            T_bitboard empty = ~occupied();
+            T_bitboard push = (white ? bit(i) << WIDTH : bit(i) >> WIDTH) & empty;
+            if(push && i / WIDTH == (white ? 1 : 6)) //Able to do 2 moves forward
+                push |= (white ? push << WIDTH : push >> WIDTH) & empty;
+            if(!addMoves(moves, m, push & targets))
+                return false;
         }
         break;
+        case Piece::rook:   if(!addMoves(moves, m, rookAttacks(i, occupied()) & targets)) return false; break;
+        case Piece::knight: if(!addMoves(moves, m, knightAttacks[i] & targets)) return false; break;
+        case Piece::bishop: if(!addMoves(moves, m, bishopAttacks(i, occupied()) & targets)) return false; break;
+        case Piece::queen:  if(!addMoves(moves, m, queenAttacks(i, occupied()) & targets)) return false; break;
+        case Piece::king: if(!addMoves(moves, m, kingAttacks[i] & targets)) return false; break;
         }
         return true;
     }
 
-    void move(const Move& move)
+    //Move with the pieces of this position, packed must be a legal move
+    Move toMove(PackedMove packed) const
+    {
+        Move m = packed.toMove();
+        m.pfrom = pieces[packed.from()];
+        m.pto = pieces[packed.to()];
+        return m;
+    }
+
+    //Converts a packed move of the player who's turn it is. Returns false if
+    //it is not legal in this position, e.g. a killer move from another branch
+    //or a hash collision.
+    bool unpackMove(PackedMove packed, Move& m, const Legality& l) const
+    {
+        int from = packed.from();
+        int to = packed.to();
+        if(packed.isNull() || !get(from).isOfColor(turn) || get(to).isOfColor(turn))
+            return false;
+        bool found = false;
+        getMoves([&](Move move) { m = move; found = true; return false; }, from, legalTargets(from, l, bit(to)));
+        return found && PackedMove(m) == packed;
+    }
+
+    bool unpackMove(PackedMove packed, Move& m) const
+    {
+        return unpackMove(packed, m, legality());
+    }
+
+    //Everything makeMove changes that can not be derived from the move itself
+    struct MoveUndo
+    {
+        Piece  captured;
+        T_hash hashVal;
+        T_hash pawnHashVal;
+        int    psqScore[PHASES];
+    };
+
+    void makeMove(const Move& move, MoveUndo& undo)
     {
         int ixFrom = toIx(move.from);
         int ixTo = toIx(move.to);
         Piece movingPiece = get(ixFrom);
-        hashVal ^= hashPiecePos(ixTo, get(move.to));   //undo to-pos
+        undo.captured = get(ixTo);
+        undo.hashVal = hashVal;
+        undo.pawnHashVal = pawnHashVal;
+        undo.psqScore[middleGame] = psqScore[middleGame];
+        undo.psqScore[endGame] = psqScore[endGame];
+        toggleBB(ixTo, undo.captured);
+        toggleBB(ixTo, movingPiece);
+        toggleBB(ixFrom, movingPiece);
+        hashVal ^= hashPiecePos(ixTo, undo.captured);  //undo to-pos
         hashVal ^= hashPiecePos(ixTo, movingPiece);    //hash new to-pos
         hashVal ^= hashPiecePos(ixFrom, movingPiece);  //undo from-pos
         hashVal ^= hashPiecePos(ixFrom, Piece(false)); //hash new from-pos (now empty)
-        set(move.to, movingPiece);
-        set(move.from, Piece(false));
+        hashVal ^= blackTurnHash;
+        if(movingPiece.piece() == Piece::pawn)
+            pawnHashVal ^= hashPiecePos(ixFrom, movingPiece) ^ hashPiecePos(ixTo, movingPiece);
+        if(undo.captured.piece() == Piece::pawn)
+            pawnHashVal ^= hashPiecePos(ixTo, undo.captured);
+        for(int ph = 0; ph < PHASES; ++ph)
+            psqScore[ph] += pieceSquareValue(Phase(ph), ixTo, movingPiece) - pieceSquareValue(Phase(ph), ixFrom, movingPiece)
+                          - pieceSquareValue(Phase(ph), ixTo, undo.captured);
+        gamePhase -= evalWeights.phase[undo.captured.piece()];
+        pieces[ixTo] = movingPiece;
+        pieces[ixFrom] = Piece(false);
+        turn = !turn;
+    }
+
+    //Takes back a move done by makeMove. Must be called in reverse order of makeMove.
+    void unmakeMove(const Move& move, const MoveUndo& undo)
+    {
+        int ixFrom = toIx(move.from);
+        int ixTo = toIx(move.to);
+        Piece movingPiece = get(ixTo);
+        toggleBB(ixFrom, movingPiece);
+        toggleBB(ixTo, movingPiece);
+        toggleBB(ixTo, undo.captured);
+        pieces[ixFrom] = movingPiece;
+        pieces[ixTo] = undo.captured;
+        hashVal = undo.hashVal;
+        pawnHashVal = undo.pawnHashVal;
+        psqScore[middleGame] = undo.psqScore[middleGame];
+        psqScore[endGame] = undo.psqScore[endGame];
+        gamePhase += evalWeights.phase[undo.captured.piece()];
+        turn = !turn;
+    }
+
+    void move(const Move& move)
+    {
+        MoveUndo undo;
+        makeMove(move, undo);
+    }
+
+    //Passes the turn, for null move pruning
+    void makeNullMove()
+    {
+        hashVal ^= blackTurnHash;
+        turn = !turn;
+    }
+
+    void unmakeNullMove(T_hash undoHash)
+    {
+        hashVal = undoHash;
         turn = !turn;
     }
 
@@ -299,22 +476,13 @@ struct Field
 
     void resetHashVal()
     {
-        hashVal = 0;
+        hashVal = turn ? 0 : blackTurnHash;
+        pawnHashVal = 0;
         for(int i=0; i<POSITIONS; ++i)
-            hashVal ^= hashPiecePos(i,get(i));
-    }
-
-    static int pieceVal(Piece::Enum e)
-    {
-        switch(e)
         {
-        case Piece::pawn: return 1;
-        case Piece::knight: return 3;
-        case Piece::bishop: return 3;
-        case Piece::rook: return 6;
-        case Piece::queen: return 10;
-        case Piece::king: return 2000000;
-        default: return 0;
+            hashVal ^= hashPiecePos(i,get(i));
+            if(get(i).piece() == Piece::pawn)
+                pawnHashVal ^= hashPiecePos(i,get(i));
         }
     }
 
@@ -322,82 +490,287 @@ struct Field
     enum eEndState { notEnded, noWhiteKing, noBlackKing, noOther };
     eEndState simpleIsEnded() const
     {
-        bool whiteKing = false;
-        bool blackKing = false;
-        bool other = false;
-        for(auto i:pieces)
-        {
-            Piece::Enum p = i.piece();
-            if(p == Piece::nothing)
-                continue;
-            if(p==Piece::king)
-            {
-                if(i.color())
-                    whiteKing = true;
-                else
-                    blackKing = true;
-            }
-            else
-                other = true;
-        }
-        if(!whiteKing)
+        if(!hasKing(true))
             return noWhiteKing;
-        if(!blackKing)
+        if(!hasKing(false))
             return noBlackKing;
-        if(!other)
+        if(!(occupied() & ~pieceBB[Piece::king]))
             return noOther;
         return notEnded;
     }
 
+    //Material and square bonus of piece p on square ix in game phase ph, negative for black.
+    //Zero for an empty square.
+    static inline int pieceSquareValue(Phase ph, int ix, Piece p)
+    {
+        return evalWeights.pieceSquare[ph][pieceCode(p)][ix];
+    }
+
+    //Piece-square score interpolated between middle game and end game by the material left
+    int taperedPsqScore() const
+    {
+        int phase = min(gamePhase, (int)EvalWeights::MAX_PHASE);
+        return (psqScore[middleGame] * phase + psqScore[endGame] * (EvalWeights::MAX_PHASE - phase))
+               / EvalWeights::MAX_PHASE;
+    }
+
     int evaluate() const
+    {
+        PawnEntry pawns;
+        evaluatePawns(pawns);
+        return evaluate(pawns);
+    }
+
+    int evaluate(const PawnEntry& pawns) const
     {
         eEndState end = simpleIsEnded();
         if(end == noWhiteKing) return turn  ? -WINDOWMAX : WINDOWMAX;
         if(end == noBlackKing) return !turn ? -WINDOWMAX : WINDOWMAX;
         if(end == noOther) return 0;
-        int total = 0;
-        for(int ix=0; ix < POSITIONS; ++ix)
+        int total = taperedPsqScore() + pawns.score + activity(true, pawns) - activity(false, pawns);
+        return turn ? total : -total;
+    }
+
+    //Pawn structure terms. They only depend on the pawns, so the search keeps
+    //them in a PawnTable.
+    void evaluatePawns(PawnEntry& e) const
+    {
+        const EvalWeights& w = evalWeights;
+        e.key = pawnHashVal;
+        e.score = 0;
+        T_bitboard attacks[2] = { 0, 0 };
+        for(int color = 0; color < 2; ++color)
+            for(T_bitboard b = piecesOf(color != 0, Piece::pawn); b; )
+                attacks[color] |= pawnAttacks[color][popLsb(b)];
+
+        for(int c = 0; c < 2; ++c)
         {
-            auto i = pieces[ix];
+            bool color = c != 0;
+            T_bitboard own = piecesOf(color, Piece::pawn);
+            T_bitboard enemy = piecesOf(!color, Piece::pawn);
             int val = 0;
-            int pval = pieceVal(i.piece());
-            if(pval == 0)
-                continue; //not a piece
-            val = pval * 10; //Having a piece is 10 times more worth than being able to capture such a piece
-            getMoves([&](Move m)
+            e.passed[color] = 0;
+            e.attackSpan[color] = attacks[color];
+            for(T_bitboard b = own; b; )
             {
-                bool bIsKing = m.pto.piece() == Piece::king;
-                bool bIsDefensive = m.pto.isOfColor(m.pfrom.color());
-                if(bIsDefensive && bIsKing)
-                    return true; //Defending own king like this is not useful
-                ++val;
-                if(m.pto.isEmpty())
-                    return true;
-                //Offensive or defensive moves count even more.
-                //Check counts for 2000 points
-                if(bIsDefensive)
-                    //It is good to defend things from around value 4
-                    //Above or below that value, is less of an issue...
-                    val += max(0, 3 - abs(pieceVal(m.pto.piece())-4));
-                else
-                    val += max(0, (bIsKing ? 10 : pieceVal(m.pto.piece())) - pval);
-                return true;
-            },ix);
-            if(!turn != !i.color())
-                val = -val;
-            total += val;
+                int ix = popLsb(b);
+                T_bitboard ahead = forwardRanks(color, ix);
+                T_bitboard neighbours = adjacentFiles(ix);
+                T_bitboard stop = color ? bit(ix) << WIDTH : bit(ix) >> WIDTH;
+                e.attackSpan[color] |= ahead & neighbours;
+                if(own & ahead & fileOf(ix))
+                    val -= w.doubledPawn; //Counted for the rear one
+                if(!(own & neighbours))
+                    val -= w.isolatedPawn;
+                else if(!(own & neighbours & ~ahead) && (attacks[!color] & stop))
+                    val -= w.backwardPawn; //No neighbour can defend it, can't safely advance
+                if(!(enemy & ahead & (fileOf(ix) | neighbours)))
+                {
+                    e.passed[color] |= bit(ix);
+                    val += w.passedPawn[color ? ix / WIDTH : HEIGHT - 1 - ix / WIDTH];
+                }
+            }
+            e.score += color ? val : -val;
         }
-        return total;
     }
 
-    void think(const T_moveProgress& moves, int maxDepth);
+    int evaluate(thinkCtxt& ctxt) const;
+
+    //Mobility, attack and defence bonus of color. Uses one attack map per
+    //piece kind of each side, instead of generating the moves of every piece.
+    int activity(bool color, const PawnEntry& pawnEntry) const
+    {
+        const EvalWeights& w = evalWeights;
+        T_bitboard occ = occupied();
+        T_bitboard own = colorBB[color];
+        T_bitboard enemy = colorBB[!color];
+        T_bitboard ownKing = piecesOf(color, Piece::king);
+        T_bitboard attackedBy[Piece::king + 1] = {}; //By piece kind
+        int val = 0;
+
+        T_bitboard pawns = piecesOf(color, Piece::pawn);
+        for(T_bitboard b = pawns; b; )
+            attackedBy[Piece::pawn] |= pawnAttacks[color][popLsb(b)];
+        T_bitboard push = (color ? pawns << WIDTH : pawns >> WIDTH) & ~occ;
+        T_bitboard doublePush = (color ? (push & RANK_3) << WIDTH : (push & RANK_6) >> WIDTH) & ~occ;
+        //Squares reached, counted at once by evalKernels
+        T_bitboard reach[3 + POSITIONS];
+        int reachCount = 0;
+        reach[reachCount++] = attackedBy[Piece::pawn] & enemy;
+        reach[reachCount++] = push;
+        reach[reachCount++] = doublePush;
+
+        for(int p = Piece::rook; p <= Piece::king; ++p)
+            for(T_bitboard b = piecesOf(color, Piece::Enum(p)); b; )
+            {
+                int ix = popLsb(b);
+                T_bitboard attacks = pieceAttacks(Piece::Enum(p), ix, occ);
+                attackedBy[p] |= attacks;
+                reach[reachCount++] = attacks & ~ownKing; //Defending own king is not useful
+            }
+        val += w.mobility * evalKernels->popCountSum(reach, reachCount);
+
+        //Knights in the enemy half, protected by a pawn, that no enemy pawn can chase away
+        T_bitboard enemyHalf = color ? 0xFFFFFFFF00000000ULL : 0x00000000FFFFFFFFULL;
+        val += w.outpost * popCount(piecesOf(color, Piece::knight) & enemyHalf
+                                    & attackedBy[Piece::pawn] & ~pawnEntry.attackSpan[!color]);
+
+        T_bitboard attacked = 0;
+        for(auto a:attackedBy)
+            attacked |= a;
+
+        //Attacking a piece worth more than the cheapest attacker
+        for(T_bitboard b = attacked & enemy; b; )
+        {
+            int ix = popLsb(b);
+            Piece::Enum victim = pieces[ix].piece();
+            for(auto attacker:PIECES_BY_VALUE)
+                if(attackedBy[attacker] & bit(ix))
+                {
+                    val += w.threat[victim][attacker];
+                    break;
+                }
+        }
+        for(T_bitboard b = attacked & own & ~ownKing; b; )
+            val += w.defended[pieces[popLsb(b)].piece()];
+        return val;
+    }
+
+    //Squares attacked by piece kind p on square ix. Pawns not supported, they depend on color.
+    static inline T_bitboard pieceAttacks(Piece::Enum p, int ix, T_bitboard occ)
+    {
+        switch(p)
+        {
+        case Piece::rook:   return rookAttacks(ix, occ);
+        case Piece::knight: return knightAttacks[ix];
+        case Piece::bishop: return bishopAttacks(ix, occ);
+        case Piece::queen:  return queenAttacks(ix, occ);
+        case Piece::king:   return kingAttacks[ix];
+        default:            return 0;
+        }
+    }
+
+    //Pieces of both colors that attack square ix, with occ as occupied squares
+    inline T_bitboard attackersTo(int ix, T_bitboard occ) const
+    {
+        return (pawnAttacks[false][ix] & piecesOf(true, Piece::pawn))
+             | (pawnAttacks[true][ix] & piecesOf(false, Piece::pawn))
+             | (knightAttacks[ix] & pieceBB[Piece::knight])
+             | (kingAttacks[ix] & pieceBB[Piece::king])
+             | (rookAttacks(ix, occ) & (pieceBB[Piece::rook] | pieceBB[Piece::queen]))
+             | (bishopAttacks(ix, occ) & (pieceBB[Piece::bishop] | pieceBB[Piece::queen]));
+    }
+
+    //Static exchange evaluation: material won by capture m when both sides keep
+    //recapturing on its square with their cheapest attacker, each side free to
+    //stop when that is better. Sliders behind an attacker join in when it moves.
+    //Only the sign is exact, a side that is lost anyway stops the calculation.
+    //http://chessprogramming.wikispaces.com/SEE+-+The+Swap+Algorithm
+    int see(const Move& m) const
+    {
+        const int* value = evalWeights.material[middleGame];
+        int to = toIx(m.to);
+        int fromIx = toIx(m.from);
+        T_bitboard from = bit(fromIx);
+        T_bitboard occ = occupied();
+        T_bitboard attackers = attackersTo(to, occ);
+        T_bitboard diagonal = pieceBB[Piece::bishop] | pieceBB[Piece::queen];
+        T_bitboard straight = pieceBB[Piece::rook] | pieceBB[Piece::queen];
+        bool side = get(fromIx).color();
+        Piece::Enum attacker = get(fromIx).piece();
+        int gain[POSITIONS + 2]; //By capture, for the side making it
+        int d = 0;
+        gain[0] = value[get(to).piece()];
+        for(;;)
+        {
+            ++d;
+            gain[d] = value[attacker] - gain[d - 1]; //If the attacker is captured in turn
+            if(max(-gain[d - 1], gain[d]) < 0)
+                break;
+            occ ^= from;
+            if(from & (diagonal | straight))
+                attackers |= (rookAttacks(to, occ) & straight) | (bishopAttacks(to, occ) & diagonal);
+            attackers &= occ;
+            side = !side;
+            from = 0;
+            for(auto p:PIECES_BY_VALUE)
+                if(T_bitboard b = attackers & piecesOf(side, p))
+                {
+                    from = b & (0 - b);
+                    attacker = p;
+                    break;
+                }
+            if(!from)
+                break;
+        }
+        while(--d)
+            gain[d - 1] = -max(-gain[d - 1], gain[d]);
+        return gain[0];
+    }
+
+    //Capture m loses material. Taking a piece worth at least the attacker never does.
+    inline bool losingCapture(const Move& m) const
+    {
+        const int* value = evalWeights.material[middleGame];
+        return value[m.pfrom.piece()] > value[m.pto.piece()] && see(m) < 0;
+    }
+
+    void think(thinkCtxt& ctxt, const T_moveProgress& moves, int maxDepth);
 
     inline bool hasKing(bool color) const
     {
-        return !!memchr(pieces, Piece(color,Piece::king).m_piece, sizeof(pieces));
+        return piecesOf(color, Piece::king) != 0;
+    }
+
+    //True if color has more than pawns and its king
+    inline bool hasPieces(bool color) const
+    {
+        return (colorBB[color] & ~pieceBB[Piece::pawn] & ~pieceBB[Piece::king]) != 0;
+    }
+
+    //ply: distance from the root
+    int score(thinkCtxt& ctxt, int depth, int ply, int a, int b, bool allowNullMove = true);
+    int quiesce(thinkCtxt& ctxt, int ply, int a, int b);
+    void queueSplitMove(thinkCtxt& ctxt, SplitPoint& split, int depth, int ply, Move m, int reduction) const;
+
+    //**** Move ordering
+    //Rank of a piece for MVV-LVA, independent of the evaluation values
+    static int victimRank(Piece::Enum e)
+    {
+        switch(e)
+        {
+        case Piece::pawn:   return 1;
+        case Piece::knight: return 2;
+        case Piece::bishop: return 3;
+        case Piece::rook:   return 4;
+        case Piece::queen:  return 5;
+        case Piece::king:   return 6;
+        default:            return 0;
+        }
     }
 
-    int score(int depth, int a, int b);
+    uint64_t perft(int depth)
+    {
+        if(depth <= 0)
+            return 1;
+        if(!hasKing(turn))
+            return 0; //No king, a position set up by fen
+        uint64_t nodes = 0;
+        getTurnMoves([&](Move m)
+        {
+            if(depth == 1)
+                ++nodes; //No need to play the move just to count it
+            else
+            {
+                MoveUndo undo;
+                makeMove(m, undo);
+                nodes += perft(depth - 1);
+                unmakeMove(m, undo);
+            }
+            return true;
+        });
+        return nodes;
+    }
 
 
     //**** Fen
@@ -475,6 +848,8 @@ struct Field
         turn = t == "w";
 
         resetHashVal();
+        resetBitboards();
+        resetPsqScore();
     }
 
     void fen(ostream& os) const
@@ -509,101 +884,704 @@ struct Field
 
     void print(ostream& os) const;
 
-    Piece pieces[POSITIONS];
-    bool  turn; //turn == true: white
+    //Largest members first, so only the end is padded. Move generation and
+    //makeMove mostly touch the bitboards, hashes and scores, which are
+    //together in less than two cache lines. The mailbox is one cache line.
+    T_bitboard pieceBB[Piece::king + 1]; //Indexed by Piece::Enum, both colors
+    T_bitboard colorBB[2];               //[true] are the white pieces
     T_hash hashVal;
+    T_hash pawnHashVal; //Of the pawns only, for the PawnTable
+    int   psqScore[PHASES]; //See resetPsqScore
+    int   gamePhase;        //Sum of EvalWeights::phase of the pieces on the board
+    bool  turn; //turn == true: white
+    Piece pieces[POSITIONS];
 };
 
-struct ScoreFound
+static_assert(sizeof(Field) == 104 + POSITIONS, "Field is copied for every split move, keep it small");
+
+// Quiet moves that caused beta cutoffs, remembered so they are tried early
+// in sibling nodes (killers) and anywhere else in the tree (history).
+// Every search thread has its own, so they are not shared.
+// http://chessprogramming.wikispaces.com/Killer+Heuristic
+// http://chessprogramming.wikispaces.com/History+Heuristic
+struct SearchHeuristics
 {
-    ScoreFound(const Field& f):state(notSet),score(0), field(f){}
-    enum State { notSet, finding, found };
-    State state;
-    int score;
-    Field field;
+    SearchHeuristics() { clear(); }
+
+    void clear()
+    {
+        fill(&killers[0][0], &killers[0][0] + MAX_PLY * 2, PackedMove());
+        memset(history,0,sizeof(history));
+    }
+
+    void addCutoff(bool color, int ply, PackedMove move, int depth)
+    {
+        if(ply < MAX_PLY && killers[ply][0] != move)
+        {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
+        }
+        int16_t& h = history[color][move.from()][move.to()];
+        h += min(depth * depth, int(HISTORY_MAX));
+        if(h >= HISTORY_MAX)
+            //Age the table, so it keeps below the killer moves and adapts to newer cutoffs
+            for(auto &c:history)
+                for(auto &from:c)
+                    for(auto &to:from)
+                        to /= 2;
+    }
+
+    //Below half the range of int16_t, so adding to it can't overflow
+    static const int HISTORY_MAX = 1 << 14;
+
+    PackedMove killers[MAX_PLY][2];
+    int16_t history[2][POSITIONS][POSITIONS]; //[color][from][to], also the range of ScoredMove::score
 };
 
-struct thinkCtxt
+// Hands out the moves of a node in search order: hash move, captures by
+// most valuable victim / least valuable attacker, killer moves, quiet moves
+// by history, then the captures that lose material by static exchange
+// evaluation. A stage is only generated when the moves before it did not
+// cause a cutoff, so a node that cuts off on the hash move or a capture
+// never generates its quiet moves.
+class MovePicker
 {
-    thinkCtxt():scoreFound(0x10000){}
+public:
+    //capturesOnly: for the quiescence search, no hash move either
+    MovePicker(const Field& field_, const SearchHeuristics& heuristics_, int ply, PackedMove hashMove_, bool capturesOnly_ = false)
+        :field(field_),heuristics(heuristics_),legality(field_.legality()),hashMove(hashMove_),capturesOnly(capturesOnly_),
+         stage(capturesOnly_ ? stageGenCaptures : stageHash),current(0),killerIx(0),losingIx(0)
+    {
+        if(ply < MAX_PLY)
+        {
+            killers[0] = heuristics.killers[ply][0];
+            killers[1] = heuristics.killers[ply][1];
+        }
+    }
+
+    //Returns false when all moves are handed out
+    bool next(Move& m)
+    {
+        for(;;)
+            switch(stage)
+            {
+            case stageHash:
+                stage = stageGenCaptures;
+                if(field.unpackMove(hashMove, m, legality))
+                    return true;
+                break;
+            case stageGenCaptures:
+                field.getTurnMoves([&](Move c)
+                {
+                    PackedMove packed(c);
+                    if(packed != hashMove)
+                        moves.push_back(ScoredMove(packed, Field::victimRank(c.pto.piece()) * 8 - Field::victimRank(c.pfrom.piece())));
+                    return true;
+                }, field.colorBB[!field.turn], legality);
+                stage = stageCaptures;
+                break;
+            case stageCaptures:
+                while(pickBest(m))
+                {
+                    if(!field.losingCapture(m))
+                        return true;
+                    losingCaptures.push_back(PackedMove(m));
+                }
+                stage = capturesOnly ? stageLosingCaptures : stageKillers;
+                break;
+            case stageKillers:
+                while(killerIx < 2)
+                {
+                    PackedMove killer = killers[killerIx++];
+                    if(killer != hashMove && field.unpackMove(killer, m, legality) && !m.capturing())
+                        return true;
+                }
+                stage = stageGenQuiets;
+                break;
+            case stageGenQuiets:
+                moves.clear();
+                current = 0;
+                field.getTurnMoves([&](Move q)
+                {
+                    PackedMove packed(q);
+                    if(packed != hashMove && packed != killers[0] && packed != killers[1])
+                        moves.push_back(ScoredMove(packed, heuristics.history[field.turn][packed.from()][packed.to()]));
+                    return true;
+                }, ~field.occupied(), legality);
+                stage = stageQuiets;
+                break;
+            case stageQuiets:
+                if(pickBest(m))
+                    return true;
+                stage = stageLosingCaptures;
+                break;
+            case stageLosingCaptures:
+                if(losingIx < losingCaptures.size())
+                {
+                    m = field.toMove(losingCaptures[losingIx++]);
+                    return true;
+                }
+                stage = stageDone;
+                break;
+            case stageDone:
+                return false;
+            }
+    }
 
-    ScoreFound& getScoreFound(const Field& f)
+    //The last move handed out is a capture that loses material
+    bool losingCapture() const { return stage == stageLosingCaptures; }
+
+private:
+    //Takes the highest scored move that is not handed out yet.
+    //Cheaper than sorting, as a cutoff often comes before all moves are tried.
+    bool pickBest(Move& m)
     {
-        auto &sfs = scoreFound[f.hash()];
-        for(auto &i:sfs)
-            if(i.field == f)
-                return i;
-        sfs.emplace_back(f);
-        return sfs.back();
+        if(current >= moves.size())
+            return false;
+        size_t best = current;
+        for(size_t j = current + 1; j < moves.size(); ++j)
+            if(moves[j].score > moves[best].score)
+                best = j;
+        swap(moves[current], moves[best]);
+        m = field.toMove(moves[current++].move);
+        return true;
     }
 
-    vector<vector<ScoreFound>> scoreFound;
+    enum Stage { stageHash, stageGenCaptures, stageCaptures, stageKillers, stageGenQuiets, stageQuiets, stageLosingCaptures, stageDone };
+
+    const Field& field;
+    const SearchHeuristics& heuristics;
+    const Field::Legality legality;
+    PackedMove hashMove;
+    PackedMove killers[2];
+    bool capturesOnly;
+    Stage stage;
+    ScoredMoveList moves; //Of the current stage
+    size_t current;       //Next move to pick in moves
+    int killerIx;
+    PackedMoveList losingCaptures; //In MVV-LVA order
+    size_t losingIx;
 };
 
-void Field::think(const T_moveProgress& moves, int maxDepth)
+// A node whose remaining moves are searched in parallel by the thread pool,
+// after the first move was searched alone (Young Brothers Wait Concept).
+// http://chessprogramming.wikispaces.com/Young+Brothers+Wait+Concept
+struct SplitPoint
 {
-    vector<MoveScore> moveScores;
-    for(int i=0; i < POSITIONS; ++i)
-        if(get(i).isOfColor(turn))
-            getMoves([&](Move m) {
-                if(m.pto.isOfColor(turn))
-                    return true;
-                moveScores.emplace_back(m,0);
+    SplitPoint(const SplitPoint* parent_, int alpha_, int beta_)
+        :parent(parent_),alpha(alpha_),beta(beta_),cutoff(false),pending(0){}
+
+    //True when this node or one of its parents had a beta cutoff
+    bool cancelled() const
+    {
+        for(const SplitPoint* sp = this; sp; sp = sp->parent)
+            if(sp->cutoff.load(memory_order_relaxed))
                 return true;
-            }, i);
+        return false;
+    }
+
+    void update(int score, PackedMove move)
+    {
+        lock_guard<mutex> lock(bestMutex);
+        if(score <= alpha)
+            return;
+        alpha = score;
+        bestMove = move;
+        if(score >= beta)
+            cutoff = true;
+    }
+
+    void addStats(const SearchStats& s)
+    {
+        lock_guard<mutex> lock(bestMutex);
+        stats += s;
+    }
+
+    const SplitPoint* parent;
+    atomic<int>  alpha;
+    const int    beta;
+    mutex        bestMutex;
+    PackedMove   bestMove;
+    atomic<bool> cutoff;
+    atomic<int>  pending; //Queued or running moves
+    SearchStats  stats;   //Of the finished moves
+};
+
+// Selective search techniques. Each can be switched off with
+// ChessBoard::setOption to compare with and without it.
+struct SearchOptions
+{
+    SearchOptions():nullMove(true),lateMoveReductions(true),futility(true),see(true){}
+
+    bool nullMove;
+    bool lateMoveReductions;
+    bool futility; //And razoring
+    bool see;      //Pruning of losing captures
+};
+
+// Ends a search when stop is set, or when it reaches the time or node limit
+// of its SearchLimits. Shared by all threads of the search. Each thread adds
+// its nodes in batches, which is also when the clock is read, so the checks
+// cost next to nothing per node.
+struct SearchControl
+{
+    SearchControl(const SearchLimits& limits, bool white)
+        :stop(false),nodes(0),maxNodes(limits.nodes),timed(false)
+    {
+        steady_clock::time_point start = steady_clock::now();
+        int time = white ? limits.whiteTime : limits.blackTime;
+        int increment = white ? limits.whiteIncrement : limits.blackIncrement;
+        if(limits.moveTime > 0)
+        {
+            timed = true;
+            softDeadline = hardDeadline = start + milliseconds(limits.moveTime);
+        }
+        else if(time > 0)
+        {
+            //An even share of the time for the moves until the next time control.
+            //An iteration takes longer than all iterations before it, so no new
+            //one is started after half of that. A running one may take twice as
+            //long, but never the last of the clock.
+            int share = time / (limits.movesToGo > 0 ? limits.movesToGo : DEFAULT_MOVES_TO_GO) + increment;
+            timed = true;
+            softDeadline = start + milliseconds(share / 2);
+            hardDeadline = start + milliseconds(max(1, min(share * 2, time - TIME_MARGIN)));
+        }
+    }
+
+    void addNodes(uint64_t count)
+    {
+        uint64_t total = nodes.fetch_add(count, memory_order_relaxed) + count;
+        if((maxNodes && total >= maxNodes) || (timed && steady_clock::now() >= hardDeadline))
+            stop = true;
+    }
+
+    //There is enough time left to start another iteration
+    bool startIteration() const
+    {
+        return !stop.load(memory_order_relaxed) && (!timed || steady_clock::now() < softDeadline);
+    }
+
+    atomic<bool> stop;      //Set to end the search
+    atomic<uint64_t> nodes; //Of all threads, each can be up to NODE_BATCH behind
+    const uint64_t maxNodes;
+    bool timed;
+    steady_clock::time_point softDeadline; //No new iteration is started after this
+    steady_clock::time_point hardDeadline; //The search stops
+};
+
+struct thinkCtxt
+{
+    thinkCtxt(TranspositionTable& tt_, EvalCache& evalCache_, SearchControl& control_, const SearchOptions& options_,
+              SearchHeuristics* heuristics_, PawnTable* pawnTable_, int threadId_ = 0)
+        :tt(tt_),evalCache(evalCache_),control(control_),options(options_),threadId(threadId_),heuristics(heuristics_),pawnTable(pawnTable_),
+         pool(nullptr),workerHeuristics(nullptr),workerPawnTables(nullptr),split(nullptr),countedNodes(0){}
+
+    bool stopped() const
+    {
+        return control.stop.load(memory_order_relaxed) || (split && split->cancelled());
+    }
+
+    void countNode()
+    {
+        if(++stats.nodes - countedNodes >= NODE_BATCH)
+            addNodes();
+    }
+
+    //Adds the nodes not in the total of SearchControl yet
+    void addNodes()
+    {
+        control.addNodes(stats.nodes - countedNodes);
+        countedNodes = stats.nodes;
+    }
+
+    TranspositionTable& tt;   //Shared by all threads
+    EvalCache& evalCache;     //Shared by all threads
+    SearchControl& control;   //Ends the search
+    const SearchOptions& options;
+    int threadId;             //0 for the main thread, helpers count up from 1
+    SearchStats stats;
+    SearchHeuristics* heuristics;       //Of the thread running this search
+    PawnTable* pawnTable;               //Of the thread running this search
+    WorkStealingPool* pool;             //When set, nodes split their moves over the pool
+    SearchHeuristics* workerHeuristics; //With pool: one per pool worker
+    PawnTable* workerPawnTables;        //With pool: one per pool worker
+    const SplitPoint* split;            //Split point this search is part of
+    uint64_t countedNodes;              //Part of stats.nodes that is in the total of control
+};
+
+void Field::think(thinkCtxt& ctxt, const T_moveProgress& moves, int maxDepth)
+{
+    MoveScoreList moveScores;
+    getTurnMoves([&](Move m) {
+        moveScores.push_back(MoveScore(m,0));
+        return true;
+    });
     if(moveScores.empty())
-        throw runtime_error("No moves possible.");
-    for(int depth = 0; depth <= maxDepth; ++depth)
+        throw runtime_error(inCheck() ? "Checkmate, no moves possible." : "Stalemate, no moves possible.");
+    //Helper threads start with other moves and skip every other depth, so they
+    //fill the transposition table with different parts of the tree.
+    if(ctxt.threadId > 0)
+        rotate(moveScores.begin(), moveScores.begin() + ctxt.threadId % moveScores.size(), moveScores.end());
+    int lastScore = 0;
+    for(int depth = ctxt.threadId % 2; depth <= maxDepth; ++depth)
     //int depth = maxDepth;
     {
-        int a = -WINDOWMAX;
-        //int a = 200000;
-        int b = WINDOWMAX;
-        for(auto &mvs : moveScores)
-        {
-            Move &m = mvs.move;
-            Field workField = *this;
-            workField.move(m);
-            int score = -workField.score(depth, -b, -a);
-            bool isSameScore = score == a;
-            if(score > a)
-                a = score;
-            //alpha/beta pruning causes even or worse scores to be pruned
-            //in which case the current highest score is returned. But it is actually
-            //probably a worse score, so it should not be the first choice.
-            //Thats why 1 is subtracted for follow up 'best' scores, which makes sure
-            //it is not the first choice.
-            mvs.score = score * 2 - (isSameScore ? 1 : 0);
+        if(depth > ctxt.threadId % 2 && !ctxt.control.startIteration())
+            return; //Not enough time left to complete another iteration
+        //Aspiration window: expect about the score of the previous iteration.
+        //When the result falls outside, search again with that side opened.
+        //http://chessprogramming.wikispaces.com/Aspiration+Windows
+        bool aspiration = depth > ctxt.threadId % 2;
+        int alpha = aspiration ? max(-WINDOWMAX, lastScore - ASPIRATION_WINDOW) : -WINDOWMAX;
+        int beta  = aspiration ? min( WINDOWMAX, lastScore + ASPIRATION_WINDOW) :  WINDOWMAX;
+        int a;
+        for(;;)
+        {
+            a = alpha;
+            //int a = 200000;
+            int b = beta;
+            bool first = true;
+            for(auto &mvs : moveScores)
+            {
+                Move &m = mvs.move;
+                MoveUndo undo;
+                makeMove(m, undo);
+                int score;
+                if(first || a >= WINDOWMAX)
+                    //Full window for the first move. Nothing beats a won game, so
+                    //after one the window is empty and cuts off right away.
+                    score = -this->score(ctxt, depth, 1, -b, -a);
+                else
+                {
+                    //Principal variation search: prove with a null window that the
+                    //move is not better, only search it fully when it is.
+                    //http://chessprogramming.wikispaces.com/Principal+Variation+Search
+                    score = -this->score(ctxt, depth, 1, -a - 1, -a);
+                    if(score > a && score < b && !ctxt.stopped())
+                        score = -this->score(ctxt, depth, 1, -b, -a);
+                }
+                unmakeMove(m, undo);
+                if(ctxt.stopped())
+                    return; //Iteration not complete, result can not be used
+                first = false;
+                bool isSameScore = score == a;
+                if(score > a)
+                    a = score;
+                //alpha/beta pruning causes even or worse scores to be pruned
+                //in which case the current highest score is returned. But it is actually
+                //probably a worse score, so it should not be the first choice.
+                //Thats why 1 is subtracted for follow up 'best' scores, which makes sure
+                //it is not the first choice.
+                mvs.score = score * 2 - (isSameScore ? 1 : 0);
+                if(a >= b && b < WINDOWMAX)
+                    break; //Fail high, searched again below
+            }
+            if(a <= alpha && alpha > -WINDOWMAX)
+                alpha = -WINDOWMAX; //Failed low
+            else if(a >= beta && beta < WINDOWMAX)
+                beta = WINDOWMAX;   //Failed high
+            else
+                break;
+            ++ctxt.stats.researches;
         }
+        lastScore = a;
         sort(moveScores.begin(), moveScores.end(),
             [](const MoveScore& l, const MoveScore& r) {return l.score > r.score;});
+        ctxt.addNodes(); //So the total is up to date for the progress
         moves(moveScores.front().move, depth, moveScores.front().score);
     }
 }
 
-int Field::score(int depth, int a, int b)
+//evaluate() through the evaluation cache of the search
+int Field::evaluate(thinkCtxt& ctxt) const
+{
+    ++ctxt.stats.evalProbes;
+    int score;
+    if(ctxt.evalCache.probe(hashVal, score))
+    {
+        ++ctxt.stats.evalHits;
+        return score;
+    }
+    ++ctxt.stats.pawnProbes;
+    PawnEntry& pawns = ctxt.pawnTable->slot(pawnHashVal);
+    if(pawns.key == pawnHashVal)
+        ++ctxt.stats.pawnHits;
+    else
+        evaluatePawns(pawns);
+    score = evaluate(pawns);
+    ctxt.evalCache.store(hashVal, score);
+    return score;
+}
+
+int Field::score(thinkCtxt& ctxt, int depth, int ply, int a, int b, bool allowNullMove)
 {
-    if(depth <= 0 || simpleIsEnded() != notEnded)
-        return evaluate();
-    auto onMove = [&](Move m)
+    ctxt.countNode();
+    if(ctxt.stopped())
+        return a;
+    if(depth <= 0)
+        return quiesce(ctxt, ply, a, b);
+    if(simpleIsEnded() != notEnded)
+        return evaluate(ctxt);
+
+    PackedMove hashMove;
+    TranspositionTable::Entry entry;
+    if(ctxt.tt.probe(hashVal, entry))
+    {
+        hashMove = entry.move;
+        if(entry.depth >= depth)
+        {
+            if(entry.bound == TranspositionTable::boundExact)
+                return entry.score;
+            if(entry.bound == TranspositionTable::boundLower && entry.score >= b)
+                return entry.score;
+            if(entry.bound == TranspositionTable::boundUpper && entry.score <= a)
+                return entry.score;
+        }
+    }
+
+    //Selectivity is not used near won or lost games, their scores are exact,
+    //nor when in check, where all evasions must be seen
+    bool inCheck = this->inCheck();
+    bool selective = a > -WINDOWMAX / 2 && b < WINDOWMAX / 2 && !inCheck;
+
+    //Null move pruning: if passing still fails high, a real move will too.
+    //Not when only pawns are left, where passing may be the best move (zugzwang).
+    //http://chessprogramming.wikispaces.com/Null+Move+Pruning
+    if(ctxt.options.nullMove && allowNullMove && selective && depth >= NULL_MOVE_MIN_DEPTH && hasPieces(turn))
+    {
+        int reduction = depth > 6 ? 3 : 2;
+        T_hash undoHash = hashVal;
+        makeNullMove();
+        int nullScore = -score(ctxt, depth - 1 - reduction, ply + 1, -b, -b + 1, false);
+        unmakeNullMove(undoHash);
+        if(ctxt.stopped())
+            return a;
+        if(nullScore >= b)
+            return b;
+    }
+
+    //Futility pruning and razoring near the leaves, when the static evaluation
+    //is so far below alpha that a quiet move is not expected to make up for it.
+    //http://chessprogramming.wikispaces.com/Futility+Pruning
+    //http://chessprogramming.wikispaces.com/Razoring
+    bool futile = false;
+    if(ctxt.options.futility && selective && depth <= 2)
     {
-        Field workField = *this;
-        workField.move(m);
-        int newScore = -workField.score(depth - 1, -b, -a);
+        int staticScore = evaluate(ctxt);
+        if(depth == 2 && staticScore + RAZOR_MARGIN * depth <= a)
+        {
+            int qScore = quiesce(ctxt, ply, a, a + 1);
+            if(qScore <= a)
+                return a;
+        }
+        futile = staticScore + FUTILITY_MARGIN[depth] <= a;
+    }
+
+    //Late move reductions: quiet moves late in the order rarely turn out best,
+    //search them less deep unless they do.
+    //http://chessprogramming.wikispaces.com/Late+Move+Reductions
+    auto reductionOf = [&](int i, const Move& m)
+    {
+        if(!ctxt.options.lateMoveReductions || !selective || depth < LMR_MIN_DEPTH || i < LMR_MIN_MOVES || m.capturing())
+            return 0;
+        return i >= 2 * LMR_MIN_MOVES && depth >= 2 * LMR_MIN_DEPTH ? 2 : 1;
+    };
+
+    //Captures that lose material by static exchange evaluation are not
+    //expected to be worth it near the leaves
+    bool pruneLosing = ctxt.options.see && selective && depth <= SEE_PRUNE_DEPTH;
+
+    MovePicker picker(*this, *ctxt.heuristics, ply, hashMove);
+    auto pruned = [&](int i, const Move& m)
+    {
+        return i > 0 && ((futile && !m.capturing()) || (pruneLosing && picker.losingCapture()));
+    };
+    int origA = a;
+    PackedMove bestMove;
+    unique_ptr<SplitPoint> split;
+    bool anyMove = false;
+    Move m;
+    for(int i = 0; picker.next(m); )
+    {
+        anyMove = true;
+        if(pruned(i, m))
+            continue;
+
+        if(i > 0 && ctxt.pool && depth >= SPLIT_MIN_DEPTH)
+        {
+            //Eldest brother is searched, the others go in parallel.
+            //Queued worst first, as this thread takes its newest task first.
+            MoveList rest;
+            int reductions[MoveList::CAPACITY];
+            do
+                if(!pruned(i, m))
+                {
+                    reductions[rest.size()] = reductionOf(i++, m);
+                    rest.push_back(m);
+                }
+            while(picker.next(m));
+            split.reset(new SplitPoint(ctxt.split, a, b));
+            for(size_t j = rest.size(); j-- > 0; )
+                queueSplitMove(ctxt, *split, depth, ply, rest[j], reductions[j]);
+            break;
+        }
+
+        MoveUndo undo;
+        makeMove(m, undo);
+        int newScore;
+        if(i == 0)
+            newScore = -score(ctxt, depth - 1, ply + 1, -b, -a);
+        else
+        {
+            //Principal variation search, see Field::think
+            int reduction = reductionOf(i, m);
+            newScore = -score(ctxt, depth - 1 - reduction, ply + 1, -a - 1, -a);
+            if(newScore > a && reduction > 0 && !ctxt.stopped())
+                newScore = -score(ctxt, depth - 1, ply + 1, -a - 1, -a);
+            if(newScore > a && newScore < b && !ctxt.stopped())
+                newScore = -score(ctxt, depth - 1, ply + 1, -b, -a);
+        }
+        unmakeMove(m, undo);
+        if(ctxt.stopped())
+            break;
         if(newScore > a)
+        {
             a = newScore;
+            bestMove = PackedMove(m);
+        }
         if(a >= b)
-            return false; //beta cutoff
-        return true;
-    };
+        {
+            //beta cutoff
+            ++ctxt.stats.cutoffs;
+            if(i == 0)
+                ++ctxt.stats.firstMoveCutoffs;
+            if(!m.capturing())
+                ctxt.heuristics->addCutoff(turn, ply, bestMove, depth);
+            break;
+        }
+        ++i;
+    }
 
-    for(int i=0; i < POSITIONS; ++i)
-        if(get(i).isOfColor(turn))
-            if(!getMoves(onMove, i))
-                return a;
+    if(!anyMove)
+        return inCheck ? -WINDOWMAX : 0; //Mate or stalemate
+
+    if(split)
+    {
+        //Help with any queued work until all moves of this node are done
+        while(split->pending > 0)
+            if(!ctxt.pool->runPendingTask())
+                this_thread::yield();
+        ctxt.stats += split->stats;
+        if(split->alpha > a)
+        {
+            a = split->alpha;
+            bestMove = split->bestMove;
+        }
+        if(a >= b && !ctxt.stopped())
+            ++ctxt.stats.cutoffs;
+    }
+    if(ctxt.stopped())
+        return a; //Result is incomplete, don't store it
+
+    TranspositionTable::Bound bound = TranspositionTable::boundExact;
+    if(a <= origA)
+        bound = TranspositionTable::boundUpper; //Nothing better found, real score may be lower
+    else if(a >= b)
+        bound = TranspositionTable::boundLower; //Cut off, real score may be higher
+    ctxt.tt.store(hashVal, a, depth, bound, bestMove);
+    return a;
+}
+
+//Searches only captures until the position is quiet, so a leaf is not
+//scored in the middle of an exchange (horizon effect).
+//http://chessprogramming.wikispaces.com/Quiescence+Search
+int Field::quiesce(thinkCtxt& ctxt, int ply, int a, int b)
+{
+    ctxt.countNode();
+    ++ctxt.stats.quiescenceNodes;
+    if(ctxt.stopped())
+        return a;
+    if(simpleIsEnded() != notEnded)
+        return evaluate(ctxt);
+    //In check all evasions are searched, as standing pat may not be possible
+    bool inCheck = this->inCheck();
+    int standPat = 0;
+    if(!inCheck)
+    {
+        //Stand pat: the side to move is not forced to capture
+        standPat = evaluate(ctxt);
+        if(standPat >= b)
+            return standPat;
+        if(standPat > a)
+            a = standPat;
+    }
+
+    MovePicker picker(*this, *ctxt.heuristics, ply, PackedMove(), !inCheck);
+    bool anyMove = false;
+    Move m;
+    while(picker.next(m))
+    {
+        anyMove = true;
+        if(!inCheck)
+        {
+            //Delta pruning: skip captures that can not bring the score near alpha
+            if(standPat + evalWeights.material[endGame][m.pto.piece()] + DELTA_MARGIN <= a)
+                continue;
+            if(ctxt.options.see && picker.losingCapture())
+                continue;
+        }
+        MoveUndo undo;
+        makeMove(m, undo);
+        int newScore = -quiesce(ctxt, ply + 1, -b, -a);
+        unmakeMove(m, undo);
+        if(ctxt.stopped())
+            break;
+        if(newScore > a)
+            a = newScore;
+        if(a >= b)
+            break;
+    }
+    if(inCheck && !anyMove)
+        return -WINDOWMAX; //Mate
     return a;
 }
 
+//Queues move m of the node at split for the pool, searched on a copy of this field
+void Field::queueSplitMove(thinkCtxt& ctxt, SplitPoint& split, int depth, int ply, Move m, int reduction) const
+{
+    SplitPoint* sp = &split;
+    const thinkCtxt* parentCtxt = &ctxt;
+    Field taskField = *this;
+    ++sp->pending;
+    ctxt.pool->push([=]() mutable
+    {
+        int worker = WorkStealingPool::currentWorker();
+        thinkCtxt taskCtxt(parentCtxt->tt, parentCtxt->evalCache, parentCtxt->control, parentCtxt->options,
+                           &parentCtxt->workerHeuristics[worker], &parentCtxt->workerPawnTables[worker], worker);
+        taskCtxt.pool = parentCtxt->pool;
+        taskCtxt.workerHeuristics = parentCtxt->workerHeuristics;
+        taskCtxt.workerPawnTables = parentCtxt->workerPawnTables;
+        taskCtxt.split = sp;
+        if(!taskCtxt.stopped())
+        {
+            MoveUndo undo;
+            taskField.makeMove(m, undo);
+            int alpha = sp->alpha;
+            int newScore = -taskField.score(taskCtxt, depth - 1 - reduction, ply + 1, -alpha - 1, -alpha);
+            if(newScore > alpha && reduction > 0 && !taskCtxt.stopped())
+                newScore = -taskField.score(taskCtxt, depth - 1, ply + 1, -alpha - 1, -alpha);
+            if(newScore > alpha && newScore < sp->beta && !taskCtxt.stopped())
+                newScore = -taskField.score(taskCtxt, depth - 1, ply + 1, -sp->beta, -sp->alpha);
+            if(!taskCtxt.stopped())
+                sp->update(newScore, PackedMove(m));
+        }
+        taskCtxt.addNodes(); //Short tasks never fill a batch
+        sp->addStats(taskCtxt.stats);
+        --sp->pending; //Last access, sp may be gone after this
+    });
+}
+
 void Field::print(ostream& os) const
 {
     Pos pos;
@@ -629,12 +1607,12 @@ void Field::print(ostream& os) const
 //Initialize has table during static init time
 const T_hash clearHashVal = []
 {
-    default_random_engine generator;
-    uniform_int_distribution<int> distribution(0,0x10000);
+    mt19937_64 generator;
 
     for(int i=0; i<POSITIONS; ++i)
-        for(int j=0; j<Piece::king*2; ++j)
-            randomHashTable[i][j] = distribution(generator);
+        for(int j=0; j<Piece::king*2 + 2; ++j)
+            randomHashTable[i][j] = generator();
+    blackTurnHash = generator();
 
     Field clearField;
     clearField.resetHashVal();
@@ -657,10 +1635,35 @@ const Piece INITIAL_FIELD[]=
 #undef PW
 #undef PB
 
+//Like makeMovesInVectorCollector, but without type erasure and allocations
+struct MoveListCollector
+{
+    MoveListCollector(MoveList& moves_, bool turn_):moves(moves_),turn(turn_){}
+
+    inline bool operator()(const Move& m) const
+    {
+        if(!m.pto.isOfColor(turn))
+            moves.push_back(m);
+        return true;
+    }
+
+    MoveList& moves;
+    bool turn;
+};
+
 class BoardImpl : public ChessBoard
 {
 public:
-    BoardImpl(){reset();}
+    BoardImpl():threadCount(1),ybwc(false),searching(false),hasBestMove(false){reset(); history.clear();}
+
+    ~BoardImpl()
+    {
+        if(searchThread.joinable())
+        {
+            searchControl->stop = true;
+            searchThread.join();
+        }
+    }
 
     virtual void print(ostream& os) const override
     {
@@ -669,13 +1672,15 @@ public:
 
     virtual void reset() override
     {
-        fields.emplace_back();
+        replaceField();
         memcpy(field().pieces, INITIAL_FIELD, sizeof(field().pieces));
         field().turn = true; //White first
         field().resetHashVal();
+        field().resetBitboards();
+        field().resetPsqScore();
     }
 
-    virtual T_moves getMoves(Pos p) override
+    void checkMovablePiece(Pos p) const
     {
         if(!field().isInside(p))
             throw runtime_error("Not a valid position");
@@ -684,31 +1689,50 @@ public:
             throw runtime_error("No piece on this position");
         if(!piece.isOfColor(field().turn))
             throw runtime_error("Not this player's turn");
+    }
+
+    virtual T_moves getMoves(Pos p) override
+    {
+        checkMovablePiece(p);
         T_moves moves;
-        field().getMoves(makeMovesInVectorCollector(moves, field().turn), p);
+        field().getMoves(MoveListCollector(moves, field().turn), p);
         return moves;
     }
 
     virtual T_moves getMoves() override
     {
         T_moves moves;
-        field().getMoves(makeMovesInVectorCollector(moves, field().turn));
+        field().getTurnMoves(MoveListCollector(moves, field().turn));
         return moves;
     }
 
+    virtual void getMoves(Pos p, MoveList& moves) override
+    {
+        checkMovablePiece(p);
+        moves.clear();
+        field().getMoves(MoveListCollector(moves, field().turn), p);
+    }
+
+    virtual void getMoves(MoveList& moves) override
+    {
+        moves.clear();
+        field().getTurnMoves(MoveListCollector(moves, field().turn));
+    }
+
     virtual void move(const Move& move) override
     {
+        checkMovablePiece(move.from);
         bool valid = false;
-        for(auto &i:getMoves(move.from))
-            if(i.to == move.to)
-            {
-                valid = true;
-                break;
-            }
+        field().getMoves([&](const Move& m)
+        {
+            valid = m.to == move.to && !m.pto.isOfColor(field().turn);
+            return !valid;
+        }, move.from);
         if(!valid)
             throw runtime_error("Not a valid move");
-        fields.emplace_back(Chess::Field(field()));
-        field().move(move);
+        history.emplace_back();
+        history.back().move = move;
+        field().makeMove(move, history.back().undo);
     }
 
     virtual void move(const char* moveStr) override
@@ -721,9 +1745,19 @@ public:
 
     virtual void undo() override
     {
-        if(fields.size() <= 1)
+        if(history.empty())
             throw runtime_error("There is no undo buffer left");
-        fields.resize(fields.size()-1);
+        HistoryEntry& last = history.back();
+        if(last.replaced)
+            current = *last.replaced;
+        else
+            current.unmakeMove(last.move, last.undo);
+        history.pop_back();
+    }
+
+    virtual void clearUndo() override
+    {
+        history.clear();
     }
 
     virtual int evaluate() const override
@@ -731,9 +1765,235 @@ public:
         return field().evaluate();
     }
 
+    virtual int see(const Move& move) const override
+    {
+        return field().see(move);
+    }
+
+    virtual bool inCheck() const override
+    {
+        return field().inCheck();
+    }
+
     virtual void think(const T_moveProgress& moves, int depth) override
     {
-        field().think(moves, depth);
+        SearchLimits limits;
+        limits.depth = depth;
+        think(moves, limits);
+    }
+
+    virtual void think(const T_moveProgress& moves, const SearchLimits& limits) override
+    {
+        SearchControl control(limits, field().turn);
+        search(field(), moves, limits, control);
+    }
+
+    virtual void startThink(const T_moveProgress& moves, const SearchLimits& limits) override
+    {
+        lock_guard<mutex> lock(thinkMutex);
+        if(searchThread.joinable())
+            throw runtime_error("Already thinking");
+        searchField = field();
+        searchControl.reset(new SearchControl(limits, searchField.turn));
+        searchError = nullptr;
+        hasBestMove = false;
+        searching = true;
+        searchThread = thread([this, moves, limits]
+        {
+            try
+            {
+                search(searchField, [&](Move m, int progress, int score)
+                {
+                    bestMove = m;
+                    hasBestMove = true;
+                    moves(m, progress, score);
+                }, limits, *searchControl);
+            }
+            catch(...)
+            {
+                searchError = current_exception();
+            }
+            searching = false;
+        });
+    }
+
+    virtual bool thinking() const override
+    {
+        return searching;
+    }
+
+    virtual Move stop() override
+    {
+        lock_guard<mutex> lock(thinkMutex);
+        if(!searchControl)
+            throw runtime_error("Not thinking");
+        searchControl->stop = true;
+        if(searchThread.joinable())
+            searchThread.join();
+        if(searchError)
+            rethrow_exception(searchError);
+        if(!hasBestMove)
+        {
+            //Stopped before the first iteration completed
+            MoveList moves;
+            searchField.getTurnMoves(MoveListCollector(moves, searchField.turn));
+            bestMove = moves.front();
+            hasBestMove = true;
+        }
+        return bestMove;
+    }
+
+    virtual uint64_t thinkNodes() const override
+    {
+        return searchControl ? searchControl->nodes.load(memory_order_relaxed) : 0;
+    }
+
+    virtual MoveList principalVariation(const Move& first) const override
+    {
+        MoveList pv;
+        Field f = field();
+        vector<T_hash> seen; //Stops at a repetition, the table would go round forever
+        if(!f.isInside(first.from) || !f.isInside(first.to))
+            throw runtime_error("Not a valid move");
+        Move m = f.toMove(PackedMove(Field::toIx(first.from), Field::toIx(first.to))); //With the pieces of this position
+        if(!f.unpackMove(PackedMove(m), m))
+            throw runtime_error("Not a valid move");
+        for(;;)
+        {
+            pv.push_back(m);
+            Field::MoveUndo undo;
+            f.makeMove(m, undo);
+            seen.push_back(f.hash());
+            TranspositionTable::Entry entry;
+            if(pv.size() >= MAX_DEPTH || !tt.probe(f.hash(), entry) || !f.unpackMove(entry.move, m))
+                break;
+            if(find(seen.begin(), seen.end(), f.hash()) != seen.end() - 1)
+                break;
+        }
+        return pv;
+    }
+
+    //Searches root, which is the same again afterwards
+    void search(Field& root, const T_moveProgress& moves, const SearchLimits& limits, SearchControl& control)
+    {
+        int depth = limits.depth < 0 ? MAX_DEPTH : min(limits.depth, MAX_DEPTH);
+        tt.newSearch();
+        stats = SearchStats();
+        //Killers and history of a previous think are of another position
+        vector<SearchHeuristics> heuristics(threadCount);
+        if((int)pawnTables.size() < threadCount)
+            pawnTables.resize(threadCount);
+
+        if(ybwc && threadCount > 1)
+        {
+            WorkStealingPool pool(threadCount - 1);
+            thinkCtxt ctxt(tt, evalCache, control, options, &heuristics[0], &pawnTables[0]);
+            ctxt.pool = &pool;
+            ctxt.workerHeuristics = heuristics.data();
+            ctxt.workerPawnTables = pawnTables.data();
+            root.think(ctxt, moves, depth);
+            stats = ctxt.stats;
+            return;
+        }
+
+        //Lazy SMP: helper threads search the same position on their own copy
+        //of the field. They only share the transposition table with the main thread.
+        //http://chessprogramming.wikispaces.com/Lazy+SMP
+        vector<thread> helpers;
+        vector<Field> helperFields(threadCount - 1, root);
+        vector<SearchStats> helperStats(threadCount - 1);
+        for(int i = 1; i < threadCount; ++i)
+            helpers.emplace_back([&, i]
+            {
+                thinkCtxt helperCtxt(tt, evalCache, control, options, &heuristics[i], &pawnTables[i], i);
+                try
+                {
+                    helperFields[i - 1].think(helperCtxt, [](Move, int, int){}, depth);
+                }
+                catch(exception&) {} //Main thread reports the same error
+                helperStats[i - 1] = helperCtxt.stats;
+            });
+
+        thinkCtxt ctxt(tt, evalCache, control, options, &heuristics[0], &pawnTables[0]);
+        auto stopHelpers = [&]
+        {
+            control.stop = true;
+            for(auto &i:helpers)
+                i.join();
+        };
+        try
+        {
+            root.think(ctxt, moves, depth);
+        }
+        catch(...)
+        {
+            stopHelpers();
+            throw;
+        }
+        stopHelpers();
+
+        stats = ctxt.stats;
+        for(auto &s:helperStats)
+            stats += s;
+    }
+
+    virtual SearchStats searchStats() const override
+    {
+        return stats;
+    }
+
+    virtual void setOption(const string& name, int value) override
+    {
+        if(name == "Hash")
+        {
+            if(value < 1)
+                throw runtime_error("Hash size should be at least 1 MB");
+            tt.resize(value);
+        }
+        else if(name == "Threads")
+        {
+            if(value < 1)
+                throw runtime_error("At least 1 thread is needed");
+            threadCount = value;
+        }
+        else if(name == "YBWC")
+            ybwc = value != 0;
+        else if(name == "EvalCache")
+        {
+            if(value < 0)
+                throw runtime_error("Evaluation cache size can not be negative");
+            evalCache.resize(value);
+        }
+        else if(name == "NullMove")
+            options.nullMove = value != 0;
+        else if(name == "LMR")
+            options.lateMoveReductions = value != 0;
+        else if(name == "Futility")
+            options.futility = value != 0;
+        else if(name == "SEE")
+            options.see = value != 0;
+        else
+            throw runtime_error("Unknown option: " + name);
+    }
+
+    virtual uint64_t perft(int depth) override
+    {
+        return field().perft(depth);
+    }
+
+    virtual uint64_t divide(int depth, const T_perftDivide& rootMoves) override
+    {
+        uint64_t total = 0;
+        for(auto &m:getMoves())
+        {
+            Field::MoveUndo undo;
+            field().makeMove(m, undo);
+            uint64_t nodes = field().perft(depth - 1);
+            field().unmakeMove(m, undo);
+            rootMoves(m, nodes);
+            total += nodes;
+        }
+        return total;
     }
 
     virtual string fen() const override
@@ -743,7 +2003,7 @@ public:
 
     virtual void fen(istream& is) override
     {
-        fields.emplace_back();
+        replaceField();
         return field().fen(is);
     }
 
@@ -759,10 +2019,43 @@ public:
         return field().hash();
     }
 
-    Field& field() { return fields.back(); }
-    const Field& field() const { return fields.back(); }
+    Field& field() { return current; }
+    const Field& field() const { return current; }
+
+    //Starts with a clear field, but keeps the old one to be able to undo
+    void replaceField()
+    {
+        history.emplace_back();
+        history.back().replaced.reset(new Field(current));
+        current = Field();
+    }
+
+    struct HistoryEntry
+    {
+        Move move;
+        Field::MoveUndo undo;
+        unique_ptr<Field> replaced; //Set when the whole field was replaced by reset or fen
+    };
 
-    vector<Field> fields;
+    Field current;
+    vector<HistoryEntry> history;
+    TranspositionTable tt;
+    EvalCache evalCache;
+    vector<PawnTable> pawnTables; //One per thread, kept between thinks
+    int threadCount;
+    bool ybwc; //Split nodes over a thread pool instead of Lazy SMP
+    SearchOptions options;
+    SearchStats stats; //Of the last think
+
+    //Of startThink
+    mutex thinkMutex; //Serializes startThink and stop
+    thread searchThread;
+    Field searchField; //Copy of the position, so the board can still be read while thinking
+    unique_ptr<SearchControl> searchControl;
+    atomic<bool> searching;
+    exception_ptr searchError;
+    Move bestMove;     //Of the last completed iteration, when hasBestMove
+    bool hasBestMove;
 };
 
 PChessBoard makeChessBoard()
@@ -2,14 +2,17 @@
 #define CHESSBOARD_H
 
 #include <memory>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <type_traits>
+#include <algorithm>
 
 namespace Chess
 {
 
-typedef unsigned short T_hash;
+typedef uint64_t T_hash;
 
 struct Pos
 {
@@ -103,6 +106,48 @@ struct Move
     Piece pto;
 };
 
+// A move in 16 bits: square index (x + y * 8) from 0..5, to 6..11 and flags
+// 12..15. Used where many moves are stored, like the move lists of the
+// search, the transposition table and the killer moves. The pieces are not
+// in it, they are on the board. All zero is no move.
+struct PackedMove
+{
+    enum Flag { flagCapture = 1 };
+
+    PackedMove():data(0){}
+    PackedMove(int from, int to, int flags = 0):data((uint16_t)(from | to << 6 | flags << 12)){}
+    explicit PackedMove(const Move& m)
+        :data(PackedMove(m.from.x + m.from.y * 8, m.to.x + m.to.y * 8, m.capturing() ? flagCapture : 0).data){}
+
+    static PackedMove fromData(uint16_t data) { PackedMove m; m.data = data; return m; }
+
+    int  from() const { return data & 0x3F; }
+    int  to() const { return data >> 6 & 0x3F; }
+    int  flags() const { return data >> 12; }
+    bool capturing() const { return (flags() & flagCapture) != 0; }
+    bool isNull() const { return data == 0; }
+
+    //Without the pieces, the board fills those in when the move is made
+    Move toMove() const { return Move(Pos(from() % 8, from() / 8), Pos(to() % 8, to() / 8)); }
+
+    bool operator==(const PackedMove& that) const { return data == that.data; }
+    bool operator!=(const PackedMove& that) const { return data != that.data; }
+
+    uint16_t data;
+};
+
+// Move with a score for move ordering, in 32 bits
+struct ScoredMove
+{
+    ScoredMove():score(0){}
+    ScoredMove(PackedMove move_, int16_t score_):move(move_),score(score_){}
+
+    PackedMove move;
+    int16_t score;
+};
+
+static_assert(sizeof(PackedMove) == 2 && sizeof(ScoredMove) == 4, "Packed moves are for dense tables");
+
 struct MoveScore
 {
     MoveScore():score(0){}
@@ -115,9 +160,58 @@ struct MoveScore
 std::ostream& operator <<(std::ostream& os, const Move& m);
 std::istream& operator >>(std::istream& is, Move& m);
 
+// Fixed capacity move list that can live on the stack, so generating moves
+// does not allocate. Without promotions one side never has more than about
+// 130 moves, so the capacity can't run out.
+template<class T_move>
+class BasicMoveList
+{
+public:
+    enum { CAPACITY = 256 };
+    typedef T_move        value_type;
+    typedef T_move*       iterator;
+    typedef const T_move* const_iterator;
+
+    BasicMoveList():count(0){}
+    template<class T_it>
+    BasicMoveList(T_it first, T_it last):count(0) { for(; first != last; ++first) push_back(*first); }
+
+    inline void push_back(const T_move& m) { begin()[count++] = m; }
+    inline iterator insert(iterator pos, const T_move& m)
+    {
+        std::copy_backward(pos, end(), end() + 1);
+        *pos = m;
+        ++count;
+        return pos;
+    }
+    inline void clear() { count = 0; }
+    inline size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+
+    inline T_move&       operator[](size_t i)       { return begin()[i]; }
+    inline const T_move& operator[](size_t i) const { return begin()[i]; }
+    inline T_move&       front()       { return *begin(); }
+    inline const T_move& front() const { return *begin(); }
+
+    inline iterator       begin()       { return reinterpret_cast<T_move*>(storage); }
+    inline iterator       end()         { return begin() + count; }
+    inline const_iterator begin() const { return reinterpret_cast<const T_move*>(storage); }
+    inline const_iterator end()   const { return begin() + count; }
+
+private:
+    //Raw storage, so constructing a list doesn't construct CAPACITY moves
+    typename std::aligned_storage<sizeof(T_move), alignof(T_move)>::type storage[CAPACITY];
+    size_t count;
+};
+
+typedef BasicMoveList<Move>      MoveList;
+typedef BasicMoveList<MoveScore> MoveScoreList;
+typedef BasicMoveList<PackedMove> PackedMoveList;
+typedef BasicMoveList<ScoredMove> ScoredMoveList;
+
 typedef std::function<bool (Move m)> T_moveCollector;
 
-typedef std::vector<Move> T_moves;
+typedef MoveList T_moves;
 
 inline T_moveCollector makeMovesInVectorCollector(T_moves& moves, bool turn)
 {
@@ -125,13 +219,71 @@ inline T_moveCollector makeMovesInVectorCollector(T_moves& moves, bool turn)
     return [=](Move m)
     {
         if(m.pfrom.isOfColor(turn) && (m.pto.isEmpty() || !m.pto.isOfColor(turn)))
-            pmoves->emplace_back(m);
+            pmoves->push_back(m);
         return true;
     };
 }
 
+//Score of a won game. The scores think reports are doubled, so they can
+//make a difference between equal and probably worse moves.
+const int MATE_SCORE = 0x7FFFFFFF / 2;
+
 typedef std::function<void (Move m, int progress, int score)> T_moveProgress;
 
+typedef std::function<void (Move m, uint64_t nodes)> T_perftDivide;
+
+struct SearchStats
+{
+    SearchStats():nodes(0),quiescenceNodes(0),cutoffs(0),firstMoveCutoffs(0),researches(0),evalProbes(0),evalHits(0),pawnProbes(0),pawnHits(0){}
+
+    SearchStats& operator+=(const SearchStats& s)
+    {
+        nodes += s.nodes;
+        quiescenceNodes += s.quiescenceNodes;
+        cutoffs += s.cutoffs;
+        firstMoveCutoffs += s.firstMoveCutoffs;
+        researches += s.researches;
+        evalProbes += s.evalProbes;
+        evalHits += s.evalHits;
+        pawnProbes += s.pawnProbes;
+        pawnHits += s.pawnHits;
+        return *this;
+    }
+
+    //Percentage of beta cutoffs caused by the first move searched.
+    //The better the move ordering, the closer to 100.
+    double firstMoveCutoffRate() const { return cutoffs ? 100.0 * firstMoveCutoffs / cutoffs : 0.0; }
+    //Percentage of evaluations answered by the evaluation cache
+    double evalHitRate() const { return evalProbes ? 100.0 * evalHits / evalProbes : 0.0; }
+    //Percentage of pawn structures found in the pawn hash table
+    double pawnHitRate() const { return pawnProbes ? 100.0 * pawnHits / pawnProbes : 0.0; }
+
+    uint64_t nodes;            //Positions visited by all threads
+    uint64_t quiescenceNodes;  //Part of nodes that was in the quiescence search
+    uint64_t cutoffs;          //Nodes that failed high
+    uint64_t firstMoveCutoffs; //Nodes that failed high on their first move
+    uint64_t researches;       //Root iterations repeated because the aspiration window failed
+    uint64_t evalProbes;       //Evaluations done by the search
+    uint64_t evalHits;         //Part of evalProbes found in the evaluation cache
+    uint64_t pawnProbes;       //Evaluations that needed the pawn structure
+    uint64_t pawnHits;         //Part of pawnProbes found in the pawn hash table
+};
+
+// When think ends. The search stops at whichever limit it reaches first.
+// With a clock but no movetime, think takes its own share of the time left.
+struct SearchLimits
+{
+    SearchLimits():depth(-1),nodes(0),moveTime(0),whiteTime(0),blackTime(0),whiteIncrement(0),blackIncrement(0),movesToGo(0){}
+
+    int depth;          //Deepest iteration, < 0 for no limit
+    uint64_t nodes;     //Nodes of all threads together, 0 for no limit
+    int moveTime;       //ms for this move, 0 for no limit
+    int whiteTime;      //ms left on the clock of white, 0 for no clock
+    int blackTime;
+    int whiteIncrement; //ms added to the clock after each move
+    int blackIncrement;
+    int movesToGo;      //Moves until the next time control, 0 when the time is for the rest of the game
+};
 
 class ChessBoard
 {
@@ -143,17 +295,64 @@ public:
 
     virtual T_moves getMoves(Pos p) =0;
     virtual T_moves getMoves() =0;
+    //Same as above, but fills an existing list
+    virtual void    getMoves(Pos p, MoveList& moves) =0;
+    virtual void    getMoves(MoveList& moves) =0;
     virtual void    move(const Move& move) =0;
     virtual void    move(const char* move) =0;
     virtual void    undo() =0;
+    //Forgets the moves and positions undo can go back to
+    virtual void    clearUndo() =0;
     virtual int     evaluate() const=0;
+    //Static exchange evaluation of a capture by the side to move: the material
+    //it wins when both sides recapture on that square as long as it pays off
+    virtual int     see(const Move& move) const=0;
+    //The king of the player who's turn it is is attacked. Without moves that is mate,
+    //otherwise stalemate. Moves never leave the own king attacked.
+    virtual bool    inCheck() const=0;
+    //moves is called with the best move after each iteration of the search
     virtual void    think(const T_moveProgress& moves, int depth) =0;
+    virtual void    think(const T_moveProgress& moves, const SearchLimits& limits) =0;
+    //Same as think, but in a background thread, moves is called from that
+    //thread. Until stop, the board must not be changed and no other think
+    //can be started.
+    virtual void    startThink(const T_moveProgress& moves, const SearchLimits& limits) =0;
+    //True until the search of startThink reached its limits or was stopped
+    virtual bool    thinking() const =0;
+    //Thread safe. Ends the search of startThink, if it didn't end already, and
+    //returns the best move of the last completed iteration. Throws when there
+    //is no move, like think.
+    virtual Move    stop() =0;
+    //Thread safe. Nodes searched so far by startThink, all threads together.
+    //Can be about a thousand nodes per thread behind.
+    virtual uint64_t
+                    thinkNodes() const =0;
+    //The move followed by the best moves of both sides after it, as far as
+    //the transposition table knows them
+    virtual MoveList
+                    principalVariation(const Move& first) const =0;
+    //Number of leaf nodes of the move generation tree of given depth
+    virtual uint64_t
+                    perft(int depth) =0;
+    //Same as perft, but reports the leaf count below each possible move
+    virtual uint64_t
+                    divide(int depth, const T_perftDivide& rootMoves) =0;
      //http://en.wikipedia.org/wiki/Forsyth%E2%80%93Edwards_Notation
     virtual std::string
                     fen() const =0;
     virtual void    fen(std::istream& is) =0;
     virtual void    fen(const char* s) =0;
     virtual T_hash  hash() const=0;
+    //Engine settings by name.
+    // "Hash":    transposition table size in MB
+    // "EvalCache": evaluation cache size in MB, 0 to switch it off
+    // "Threads": number of threads used by think
+    // "YBWC":    1 to split nodes over the threads instead of Lazy SMP
+    // "NullMove", "LMR", "Futility", "SEE": 0 to switch off that part of the selective search
+    virtual void    setOption(const std::string& name, int value) =0;
+    //Statistics of the last think
+    virtual SearchStats
+                    searchStats() const =0;
 };
 
 typedef std::shared_ptr<ChessBoard> PChessBoard;
@@ -0,0 +1,31 @@
+#include "evalcache.h"
+
+using namespace std;
+
+namespace Chess
+{
+
+void EvalCache::resize(size_t megaBytes)
+{
+    slots.reset(); //Release the old cache before allocating the new one
+    slotCount = 0;
+    if(megaBytes == 0)
+        return;
+
+    size_t count = 1;
+    while(count * 2 * sizeof(atomic<uint64_t>) <= megaBytes * 1024 * 1024)
+        count *= 2;
+
+    slots.reset(new atomic<uint64_t>[count]);
+    slotCount = count;
+    clear();
+}
+
+void EvalCache::clear()
+{
+    //An empty slot only matches keys with all upper 32 bits set
+    for(size_t i = 0; i < slotCount; ++i)
+        slots[i].store(0xFFFFFFFF00000000ULL, memory_order_relaxed);
+}
+
+}//namespace Chess
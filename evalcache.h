@@ -0,0 +1,62 @@
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "chessboard.h"
+
+namespace Chess
+{
+
+// Remembers the static evaluation of positions by hash, as transpositions
+// make the search evaluate the same leaf many times.
+// http://chessprogramming.wikispaces.com/Evaluation+Hash+Table
+//
+// Direct mapped: a position can only be in the slot selected by the lower
+// bits of its key. The upper 32 bits of the key and the score share one
+// 64-bit word, so threads can share the cache without locking and without
+// torn reads.
+class EvalCache
+{
+public:
+    //Small by default: the evaluation is cheap enough that a cache missing
+    //the CPU caches costs more than it saves.
+    explicit EvalCache(size_t megaBytes = 1) { resize(megaBytes); }
+
+    //Slot count is rounded down to a power of two, 0 switches the cache off.
+    //Not thread safe.
+    void resize(size_t megaBytes);
+    //Not thread safe.
+    void clear();
+
+    size_t sizeMB() const { return slotCount * sizeof(*slots.get()) / (1024 * 1024); }
+
+    bool probe(T_hash key, int& score) const
+    {
+        if(!slotCount)
+            return false;
+        uint64_t data = slots[key & (slotCount - 1)].load(std::memory_order_relaxed);
+        if((data ^ key) >> 32)
+            return false;
+        score = (int32_t)(uint32_t)data;
+        return true;
+    }
+
+    void store(T_hash key, int score)
+    {
+        if(!slotCount)
+            return;
+        uint64_t data = (key & 0xFFFFFFFF00000000ULL) | (uint32_t)score;
+        slots[key & (slotCount - 1)].store(data, std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    size_t slotCount = 0;
+};
+
+}
+
+#endif // EVALCACHE_H
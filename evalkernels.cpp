@@ -0,0 +1,207 @@
+#include "evalkernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CHESS_X86_KERNELS
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define CHESS_TARGET(t)
+#else
+#include <immintrin.h>
+//Allows the instruction set in this function only, the rest of the program
+//does not need to be built for it.
+#define CHESS_TARGET(t) __attribute__((target(t)))
+#endif
+#endif
+
+using namespace std;
+
+namespace Chess
+{
+
+static_assert(sizeof(Piece) == 1, "Kernels read the board as bytes");
+
+namespace
+{
+
+//**** Scalar reference
+
+int pieceSquareSumScalar(const Piece* pieces, const int (*table)[SQUARES])
+{
+    int sum = 0;
+    for(int sq = 0; sq < SQUARES; ++sq)
+        sum += table[pieceCode(pieces[sq])][sq];
+    return sum;
+}
+
+int popCountSumScalar(const T_bitboard* bbs, int count)
+{
+    int sum = 0;
+    for(int i = 0; i < count; ++i)
+        sum += popCount(bbs[i]);
+    return sum;
+}
+
+const EvalKernels scalarKernels = { "scalar", pieceSquareSumScalar, popCountSumScalar };
+
+#ifdef CHESS_X86_KERNELS
+
+//**** SSE2
+
+CHESS_TARGET("sse2") inline int horizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+    return _mm_cvtsi128_si32(v);
+}
+
+//Sum of both 64-bit lanes
+CHESS_TARGET("sse2") inline int horizontalSum64(__m128i v)
+{
+    return _mm_cvtsi128_si32(v) + _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+}
+
+//SSE2 has no gather, so only the table indexes are computed in parallel
+CHESS_TARGET("sse2") int pieceSquareSumSse2(const Piece* pieces, const int (*table)[SQUARES])
+{
+    const int* t = table[0];
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lanes = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    __m128i sum = zero;
+    for(int sq = 0; sq < SQUARES; sq += 8)
+    {
+        __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pieces + sq)), zero);
+        __m128i code = _mm_or_si128(_mm_and_si128(p, _mm_set1_epi16(0x0F)),
+                                    _mm_and_si128(_mm_srli_epi16(p, 4), _mm_set1_epi16(0x08)));
+        __m128i ix = _mm_add_epi16(_mm_slli_epi16(code, 6), _mm_add_epi16(lanes, _mm_set1_epi16((short)sq)));
+        sum = _mm_add_epi32(sum, _mm_setr_epi32(t[_mm_extract_epi16(ix, 0)], t[_mm_extract_epi16(ix, 1)],
+                                                t[_mm_extract_epi16(ix, 2)], t[_mm_extract_epi16(ix, 3)]));
+        sum = _mm_add_epi32(sum, _mm_setr_epi32(t[_mm_extract_epi16(ix, 4)], t[_mm_extract_epi16(ix, 5)],
+                                                t[_mm_extract_epi16(ix, 6)], t[_mm_extract_epi16(ix, 7)]));
+    }
+    return horizontalSum(sum);
+}
+
+//Counts bits in parallel within each byte, then sums the bytes
+//http://chessprogramming.wikispaces.com/Population+Count#SWAR-Popcount
+CHESS_TARGET("sse2") int popCountSumSse2(const T_bitboard* bbs, int count)
+{
+    __m128i sum = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 2 <= count; i += 2)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bbs + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), _mm_set1_epi8(0x55)));
+        v = _mm_add_epi8(_mm_and_si128(v, _mm_set1_epi8(0x33)), _mm_and_si128(_mm_srli_epi64(v, 2), _mm_set1_epi8(0x33)));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), _mm_set1_epi8(0x0F));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    int ret = horizontalSum64(sum);
+    for(; i < count; ++i)
+        ret += popCount(bbs[i]);
+    return ret;
+}
+
+const EvalKernels sse2Kernels = { "sse2", pieceSquareSumSse2, popCountSumSse2 };
+
+//**** AVX2
+
+CHESS_TARGET("avx2") int pieceSquareSumAvx2(const Piece* pieces, const int (*table)[SQUARES])
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i sum = _mm256_setzero_si256();
+    for(int sq = 0; sq < SQUARES; sq += 8)
+    {
+        __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pieces + sq)));
+        __m256i code = _mm256_or_si256(_mm256_and_si256(p, _mm256_set1_epi32(0x0F)),
+                                       _mm256_and_si256(_mm256_srli_epi32(p, 4), _mm256_set1_epi32(0x08)));
+        __m256i ix = _mm256_add_epi32(_mm256_slli_epi32(code, 6), _mm256_add_epi32(lanes, _mm256_set1_epi32(sq)));
+        sum = _mm256_add_epi32(sum, _mm256_i32gather_epi32(table[0], ix, 4));
+    }
+    return horizontalSum(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+}
+
+//Looks up the bit count of each nibble with a shuffle
+//http://0x80.pl/articles/sse-popcount.html
+CHESS_TARGET("avx2") int popCountSumAvx2(const T_bitboard* bbs, int count)
+{
+    const __m256i nibbleCount = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bbs + i));
+        __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(nibbleCount, _mm256_and_si256(v, lowNibble)),
+                                        _mm256_shuffle_epi8(nibbleCount, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibble)));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+    }
+    int ret = horizontalSum64(_mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+    for(; i < count; ++i)
+        ret += popCount(bbs[i]);
+    return ret;
+}
+
+const EvalKernels avx2Kernels = { "avx2", pieceSquareSumAvx2, popCountSumAvx2 };
+
+//**** CPU detection
+
+#ifdef _MSC_VER
+bool cpuHasSse2()
+{
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+}
+
+bool cpuHasAvx2()
+{
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; //OSXSAVE, XMM and YMM state
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+}
+#else
+bool cpuHasSse2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+bool cpuHasAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#endif //CHESS_X86_KERNELS
+
+vector<const EvalKernels*> detectEvalKernels()
+{
+    vector<const EvalKernels*> kernels(1, &scalarKernels);
+#ifdef CHESS_X86_KERNELS
+    if(cpuHasSse2())
+        kernels.push_back(&sse2Kernels);
+    if(cpuHasAvx2())
+        kernels.push_back(&avx2Kernels);
+#endif
+    return kernels;
+}
+
+}//namespace
+
+const vector<const EvalKernels*>& supportedEvalKernels()
+{
+    static const vector<const EvalKernels*> kernels = detectEvalKernels();
+    return kernels;
+}
+
+const EvalKernels* evalKernels = supportedEvalKernels().back();
+
+}//namespace Chess
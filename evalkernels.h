@@ -0,0 +1,33 @@
+#ifndef EVALKERNELS_H
+#define EVALKERNELS_H
+
+#include <vector>
+#include "chessboard.h"
+#include "bitboard.h"
+#include "evalweights.h"
+
+namespace Chess
+{
+
+// The summations of the evaluation over the whole board, in a scalar,
+// SSE2 and AVX2 version. All versions give identical results. The fastest
+// one the CPU supports is chosen at startup, using CPUID, so the program
+// still runs on CPUs without AVX2.
+struct EvalKernels
+{
+    const char* name;
+    //Sum of table[pieceCode(pieces[sq])][sq] over all squares
+    int (*pieceSquareSum)(const Piece* pieces, const int (*table)[SQUARES]);
+    //Number of set bits in count bitboards
+    int (*popCountSum)(const T_bitboard* bbs, int count);
+};
+
+//Kernels this CPU can run, the scalar reference first and the fastest last
+const std::vector<const EvalKernels*>& supportedEvalKernels();
+
+//Used by the evaluation
+extern const EvalKernels* evalKernels;
+
+}
+
+#endif // EVALKERNELS_H
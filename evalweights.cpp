@@ -0,0 +1,239 @@
+#include "evalweights.h"
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Chess
+{
+
+namespace
+{
+
+//**** Compile time generated defaults
+
+//Exchange value of the pieces, by Piece::Enum
+constexpr int PIECE_VALUE[PIECE_KINDS] = { 0, 1, 6, 3, 3, 10, 2000000 };
+
+constexpr int DEFAULT_MATERIAL[PHASES][PIECE_KINDS] =
+{
+    { 0, 10, 60, 30, 30, 100, 20000000 },
+    { 0, 12, 62, 30, 32, 100, 20000000 }
+};
+
+//C++11 has no std::integer_sequence
+template<int... I> struct Indices {};
+template<int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template<int... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template<int N> struct Table { int values[N]; };
+
+template<int N, int (*F)(int), int... I>
+constexpr Table<N> makeTable(Indices<I...>) { return Table<N>{{ F(I)... }}; }
+
+//Table of N values, value i is F(i)
+template<int N, int (*F)(int)>
+constexpr Table<N> makeTable() { return makeTable<N, F>(typename MakeIndices<N>::type()); }
+
+constexpr int absolute(int v) { return v < 0 ? -v : v; }
+constexpr int maximum(int a, int b) { return a > b ? a : b; }
+constexpr int file(int sq) { return sq % 8; }
+constexpr int rank(int sq) { return sq / 8; }
+
+//0 on the edge up to 3 in the center
+constexpr int fileCentrality(int sq) { return 3 - absolute(2 * file(sq) - 7) / 2; }
+constexpr int rankCentrality(int sq) { return 3 - absolute(2 * rank(sq) - 7) / 2; }
+constexpr int centrality(int sq) { return fileCentrality(sq) + rankCentrality(sq); }
+constexpr int innerCentrality(int sq) { return fileCentrality(sq) < rankCentrality(sq) ? fileCentrality(sq) : rankCentrality(sq); }
+
+constexpr int PAWN_ADVANCE[PHASES][8] =
+{
+    { 0, 0, 1, 1, 2, 3, 5, 0 }, //No promotion, a pawn on the last rank is stuck
+    { 0, 0, 1, 2, 4, 6, 9, 0 }
+};
+constexpr int KNIGHT_CENTRALITY[7] = { -5, -3, -2, -1, 1, 2, 3 };
+
+constexpr int none(int) { return 0; }
+constexpr int pawnMg(int sq)
+{
+    return PAWN_ADVANCE[middleGame][rank(sq)]
+         + (rank(sq) >= 3 && rank(sq) <= 5 ? maximum(0, fileCentrality(sq) - 1) : 0)
+         - (rank(sq) == 1 && fileCentrality(sq) == 3 ? 1 : 0); //Free the way for the bishops
+}
+constexpr int pawnEg(int sq) { return PAWN_ADVANCE[endGame][rank(sq)]; }
+//Seventh rank, or the center files of the first rank. Edge files in between are bad.
+constexpr int rookMg(int sq)
+{
+    return rank(sq) == 0 ? maximum(0, fileCentrality(sq) - 1)
+         : rank(sq) == 6 ? (fileCentrality(sq) == 0 ? 2 : 3)
+         : rank(sq) == 7 ? 0
+         : (fileCentrality(sq) == 0 ? -1 : 0);
+}
+constexpr int rookEg(int sq) { return rank(sq) == 6 ? 2 : 0; }
+constexpr int knight(int sq) { return KNIGHT_CENTRALITY[centrality(sq)]; }
+constexpr int bishop(int sq) { return centrality(sq) == 0 ? -2 : innerCentrality(sq) == 0 ? -1 : 1; }
+constexpr int queenMg(int sq) { return centrality(sq) == 0 ? -2 : innerCentrality(sq) == 0 ? -1 : innerCentrality(sq) >= 2 ? 1 : 0; }
+constexpr int queenEg(int sq) { return innerCentrality(sq) - 1; }
+//Behind its pawns in the middle game, to the center in the end game
+constexpr int kingMg(int sq)
+{
+    return rank(sq) == 0 ? (fileCentrality(sq) == 1 ? 3 : fileCentrality(sq) == 0 ? 2 : 3 - fileCentrality(sq))
+         : rank(sq) == 1 ? (fileCentrality(sq) <= 1 ? 2 : 0)
+         : rank(sq) == 2 ? (fileCentrality(sq) == 0 ? -1 : -2)
+         : 1 - (rank(sq) < 4 ? rank(sq) : 4) - (fileCentrality(sq) > 0 ? 1 : 0) - (fileCentrality(sq) == 3 ? 1 : 0);
+}
+constexpr int kingEg(int sq) { return centrality(sq) - 3; }
+
+constexpr Table<SQUARES> DEFAULT_SQUARE[PHASES][PIECE_KINDS] =
+{
+    {
+        makeTable<SQUARES, none>(),   makeTable<SQUARES, pawnMg>(),   makeTable<SQUARES, rookMg>(),
+        makeTable<SQUARES, knight>(), makeTable<SQUARES, bishop>(), makeTable<SQUARES, queenMg>(),
+        makeTable<SQUARES, kingMg>()
+    },
+    {
+        makeTable<SQUARES, none>(),   makeTable<SQUARES, pawnEg>(),   makeTable<SQUARES, rookEg>(),
+        makeTable<SQUARES, knight>(), makeTable<SQUARES, bishop>(), makeTable<SQUARES, queenEg>(),
+        makeTable<SQUARES, kingEg>()
+    }
+};
+
+//Attacking a piece worth more than the attacker, by victim * PIECE_KINDS + attacker.
+//Check counts as 10.
+constexpr int threat(int i)
+{
+    return maximum(0, (i / PIECE_KINDS == Piece::king ? 10 : PIECE_VALUE[i / PIECE_KINDS]) - PIECE_VALUE[i % PIECE_KINDS]);
+}
+constexpr Table<PIECE_KINDS * PIECE_KINDS> DEFAULT_THREAT = makeTable<PIECE_KINDS * PIECE_KINDS, threat>();
+
+//It is good to defend things from around value 4.
+//Above or below that value, is less of an issue...
+constexpr int defended(int p) { return p == Piece::king ? 0 : maximum(0, 3 - absolute(PIECE_VALUE[p] - 4)); }
+constexpr Table<PIECE_KINDS> DEFAULT_DEFENDED = makeTable<PIECE_KINDS, defended>();
+
+constexpr int DEFAULT_PHASE[PIECE_KINDS] = { 0, 0, 2, 1, 1, 4, 0 };
+constexpr int DEFAULT_PASSED_PAWN[8] = { 0, 1, 1, 2, 3, 5, 7, 0 };
+
+//**** Names in the weights file
+
+struct WeightRef
+{
+    string name;
+    int*   values;
+    int    count;
+};
+
+const char* PIECE_NAMES[PIECE_KINDS] = { "nothing", "pawn", "rook", "knight", "bishop", "queen", "king" };
+const char* PHASE_NAMES[PHASES] = { "mg", "eg" };
+
+vector<WeightRef> weightRefs(EvalWeights& w)
+{
+    vector<WeightRef> refs;
+    for(int ph = 0; ph < PHASES; ++ph)
+    {
+        refs.push_back({ string("material_") + PHASE_NAMES[ph], w.material[ph], PIECE_KINDS });
+        for(int p = Piece::pawn; p < PIECE_KINDS; ++p)
+            refs.push_back({ string("square_") + PHASE_NAMES[ph] + "_" + PIECE_NAMES[p], w.square[ph][p], SQUARES });
+    }
+    refs.push_back({ "phase",         w.phase,         PIECE_KINDS });
+    refs.push_back({ "mobility",      &w.mobility,     1 });
+    refs.push_back({ "threat",        &w.threat[0][0], PIECE_KINDS * PIECE_KINDS });
+    refs.push_back({ "defended",      w.defended,      PIECE_KINDS });
+    refs.push_back({ "doubled_pawn",  &w.doubledPawn,  1 });
+    refs.push_back({ "isolated_pawn", &w.isolatedPawn, 1 });
+    refs.push_back({ "backward_pawn", &w.backwardPawn, 1 });
+    refs.push_back({ "passed_pawn",   w.passedPawn,    8 });
+    refs.push_back({ "outpost",       &w.outpost,      1 });
+    return refs;
+}
+
+}//namespace
+
+EvalWeights evalWeights;
+
+EvalWeights::EvalWeights()
+{
+    for(int ph = 0; ph < PHASES; ++ph)
+        for(int p = 0; p < PIECE_KINDS; ++p)
+        {
+            material[ph][p] = DEFAULT_MATERIAL[ph][p];
+            for(int sq = 0; sq < SQUARES; ++sq)
+                square[ph][p][sq] = DEFAULT_SQUARE[ph][p].values[sq];
+        }
+    for(int p = 0; p < PIECE_KINDS; ++p)
+    {
+        phase[p] = DEFAULT_PHASE[p];
+        defended[p] = DEFAULT_DEFENDED.values[p];
+        for(int a = 0; a < PIECE_KINDS; ++a)
+            threat[p][a] = DEFAULT_THREAT.values[p * PIECE_KINDS + a];
+    }
+    mobility = 1;
+    doubledPawn = 4;
+    isolatedPawn = 3;
+    backwardPawn = 2;
+    for(int r = 0; r < 8; ++r)
+        passedPawn[r] = DEFAULT_PASSED_PAWN[r];
+    outpost = 3;
+    update();
+}
+
+void EvalWeights::update()
+{
+    for(int ph = 0; ph < PHASES; ++ph)
+        for(int code = 0; code < PIECE_CODES; ++code)
+            for(int sq = 0; sq < SQUARES; ++sq)
+            {
+                int p = code & 0x07;
+                bool white = (code & 0x08) != 0;
+                int ix = white ? sq : sq ^ (SQUARES - 8); //Mirror rank for black
+                int val = p == Piece::nothing || p >= PIECE_KINDS ? 0 : material[ph][p] + square[ph][p][ix];
+                pieceSquare[ph][code][sq] = white ? val : -val;
+            }
+}
+
+void EvalWeights::read(istream& is)
+{
+    vector<WeightRef> refs = weightRefs(*this);
+    string name;
+    while(is >> name)
+    {
+        if(name[0] == '#')
+        {
+            getline(is, name);
+            continue;
+        }
+        WeightRef* ref = nullptr;
+        for(auto &r:refs)
+            if(r.name == name)
+                ref = &r;
+        if(!ref)
+            throw runtime_error("Unknown evaluation weight: " + name);
+        for(int i = 0; i < ref->count; ++i)
+            if(!(is >> ref->values[i]))
+                throw runtime_error("Too few values for evaluation weight: " + name);
+    }
+    update();
+}
+
+void EvalWeights::write(ostream& os) const
+{
+    os << "# Chess evaluation weights. Piece order: nothing pawn rook knight bishop queen king." << endl
+       << "# Squares are from whites view, first rank first." << endl;
+    ios::fmtflags flags = os.flags();
+    os << right;
+    for(auto &r:weightRefs(const_cast<EvalWeights&>(*this)))
+    {
+        os << r.name;
+        for(int i = 0; i < r.count; ++i)
+            if(r.count == SQUARES)
+                os << (i % 8 == 0 ? "\n" : "") << setw(4) << r.values[i];
+            else
+                os << ' ' << r.values[i];
+        os << endl;
+    }
+    os.flags(flags);
+}
+
+}//namespace Chess
@@ -0,0 +1,65 @@
+#ifndef EVALWEIGHTS_H
+#define EVALWEIGHTS_H
+
+#include <iostream>
+#include "chessboard.h"
+
+namespace Chess
+{
+
+// The evaluation interpolates between a middle game and an end game score,
+// by the material that is left on the board (tapered evaluation).
+// http://chessprogramming.wikispaces.com/Tapered+Eval
+enum Phase { middleGame, endGame, PHASES };
+
+const int SQUARES = 64;
+const int PIECE_KINDS = Piece::king + 1; //Indexed by Piece::Enum, including nothing
+const int PIECE_CODES = 16;              //See pieceCode
+
+//Piece kind and color in one index: black pieces are 0 to 7, white 8 to 15.
+//Empty squares map to a code of piece kind nothing.
+inline int pieceCode(Piece p) { return (p.m_piece & 0x0F) | ((p.m_piece >> 4) & 0x08); }
+
+// Everything the evaluation is weighted with. The defaults are generated at
+// compile time. They can be replaced by weights read from a file, for tuning.
+struct EvalWeights
+{
+    EvalWeights(); //The defaults
+
+    //Material plus square bonus by pieceCode, from whites view with the
+    //first rank first: black pieces have the mirrored white values negated.
+    //Derived from material and square by update(), this is the table the
+    //evaluation uses.
+    int pieceSquare[PHASES][PIECE_CODES][SQUARES];
+
+    int material[PHASES][PIECE_KINDS];
+    int square[PHASES][PIECE_KINDS][SQUARES];
+    int phase[PIECE_KINDS];    //Game phase each piece is worth, the sum is clamped to MAX_PHASE
+    int mobility;              //Per attacked square
+    int threat[PIECE_KINDS][PIECE_KINDS]; //[victim][cheapest attacker]
+    int defended[PIECE_KINDS]; //Piece defended by at least one own piece
+    int doubledPawn;
+    int isolatedPawn;
+    int backwardPawn;
+    int passedPawn[8];         //By rank from own side
+    int outpost;               //Knight in the enemy half that pawns can't chase away
+
+    static const int MAX_PHASE = 24; //All pieces on the board
+
+    //Recalculates pieceSquare
+    void update();
+
+    //Text format: the name of each weight followed by its values, separated
+    //by white space. From # up to the end of the line is a comment. Weights that are not in the stream
+    //keep their value. Throws on unknown names or missing values.
+    void read(std::istream& is);
+    void write(std::ostream& os) const;
+};
+
+//Used by the evaluation. Change it before creating boards, existing boards
+//keep their incremental scores.
+extern EvalWeights evalWeights;
+
+}
+
+#endif // EVALWEIGHTS_H
@@ -3,7 +3,11 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <chrono>
+#include <fstream>
 #include "chessboard.h"
+#include "evalweights.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -29,6 +33,7 @@ void skipWsNow(istream& str)
 }
 
 namespace ChessTest{ void test(); }
+namespace ChessBench{ void bench(istream& params); }
 
 void printMoves(const Chess::T_moves& moves)
 {
@@ -44,11 +49,59 @@ void printMoves(const Chess::T_moves& moves)
     cout << endl;
 }
 
+void printNodeCount(uint64_t nodes, chrono::steady_clock::time_point start)
+{
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Nodes: " << nodes << ", " << fixed << setprecision(3) << seconds << " s, "
+         << setprecision(0) << nodes / max(seconds, 1e-9) << " nodes/s" << endl;
+    cout.unsetf(ios::floatfield);
+}
+
+void printSearchStats(const Chess::SearchStats& stats)
+{
+    cout << "Quiescence nodes: " << stats.quiescenceNodes << ", aspiration researches: " << stats.researches << endl;
+    cout << "Cutoffs: " << stats.cutoffs << ", on first move: " << fixed << setprecision(1)
+         << stats.firstMoveCutoffRate() << "%" << endl;
+    cout << "Evaluations: " << stats.evalProbes << ", eval cache hits: " << stats.evalHitRate()
+         << "%, pawn table hits: " << stats.pawnHitRate() << "%" << endl;
+    cout.unsetf(ios::floatfield);
+}
+
+int readDepth(istream& params)
+{
+    int depth = -1;
+    params >> depth;
+    if(depth < 1)
+        throw runtime_error("Depth of 1 or more expected");
+    return depth;
+}
+
+void loadEvalWeights(const char* path)
+{
+    ifstream file(path);
+    if(!file)
+        throw runtime_error(string("Can't open evaluation weights file ") + path);
+    Chess::evalWeights.read(file);
+}
+
+//Usage: Chess [evaluation weights file]
 int main(int argc, char *argv[])
 {
-    (void)argc;(void)argv;
     using namespace Chess;
 
+    if(argc > 1)
+    {
+        try
+        {
+            loadEvalWeights(argv[1]);
+        }
+        catch(runtime_error& e)
+        {
+            cout << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
     bool quit = false;
     PChessBoard board = makeChessBoard();
     function<void()> printHelp;
@@ -135,21 +188,82 @@ int main(int argc, char *argv[])
                 cout << "Evaluation value: " << board->evaluate() << endl;
             }
         },
+        {
+            "weights", "",
+            "Print the evaluation weights, or write them to given file. Load them by giving the file on the command line",
+            [&](istream& params)
+            {
+                string path;
+                params >> path;
+                if(path.empty())
+                {
+                    evalWeights.write(cout);
+                    return;
+                }
+                ofstream file(path);
+                evalWeights.write(file);
+                if(!file)
+                    throw runtime_error("Can't write " + path);
+            }
+        },
         {
             "think", "t",
-            "Think of a good move",
+            "Think of a good move. Optionally give depth and number of threads",
             [&](istream& params)
             {
                 int depth = -1;
-                params >> depth;
+                int threads = -1;
+                params >> depth >> threads;
                 if(depth < 0)
                     depth = 4;
+                if(threads > 0)
+                    board->setOption("Threads", threads);
                 moves.clear();
+                auto start = chrono::steady_clock::now();
                 board->think([&](Move m, int progress, int score)
                 {
                     cout << (1 + depth - progress) << ". " << m << ": " << score << endl;
                     moves.insert(moves.begin(), m);
                 }, depth);
+                printNodeCount(board->searchStats().nodes, start);
+                printSearchStats(board->searchStats());
+            }
+        },
+        {
+            "option", "o",
+            "Set an engine option. E.g. 'option Hash 64' for 64 MB hash table",
+            [&](istream& params)
+            {
+                string name;
+                int value = 0;
+                params >> name >> value;
+                if(!params)
+                    throw runtime_error("Option name and value expected");
+                board->setOption(name, value);
+            }
+        },
+        {
+            "perft", "",
+            "Count leaf nodes of the move generation tree of given depth",
+            [&](istream& params)
+            {
+                int depth = readDepth(params);
+                auto start = chrono::steady_clock::now();
+                printNodeCount(board->perft(depth), start);
+            }
+        },
+        {
+            "divide", "",
+            "Perft, but also list the leaf nodes below each move",
+            [&](istream& params)
+            {
+                int depth = readDepth(params);
+                auto start = chrono::steady_clock::now();
+                uint64_t nodes = board->divide(depth, [&](Move m, uint64_t moveNodes)
+                {
+                    cout << m << ": " << moveNodes << endl;
+                });
+                printNodeCount(nodes, start);
             }
         },
         {
@@ -166,6 +280,15 @@ int main(int argc, char *argv[])
                 board->fen(params);
             }
         },
+        {
+            "uci", "",
+            "Switch to the UCI protocol, for chess GUIs. Ends with quit",
+            [&](istream&)
+            {
+                ChessUci::run(board, cin, cout);
+                quit = true;
+            }
+        },
         {
             "test", "t",
             "Start automatic tests",
@@ -173,6 +296,14 @@ int main(int argc, char *argv[])
             {
                 ChessTest::test();
             }
+        },
+        {
+            "bench", "b",
+            "Run a benchmark. Without name, lists available benchmarks",
+            [&](istream& params)
+            {
+                ChessBench::bench(params);
+            }
         }
     };
 
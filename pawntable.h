@@ -0,0 +1,48 @@
+#ifndef PAWNTABLE_H
+#define PAWNTABLE_H
+
+#include <vector>
+#include <cstddef>
+#include "chessboard.h"
+#include "bitboard.h"
+
+namespace Chess
+{
+
+// Evaluation of a pawn structure. Only depends on the pawns, so it is the
+// same in most nodes of a search.
+struct PawnEntry
+{
+    PawnEntry():key(0),score(0)
+    {
+        passed[0] = passed[1] = 0;
+        attackSpan[0] = attackSpan[1] = 0;
+    }
+
+    T_hash     key;           //Pawn hash, see Field::pawnHashVal
+    int        score;         //From whites view
+    T_bitboard passed[2];     //Passed pawns, [true]: white
+    T_bitboard attackSpan[2]; //Squares the pawns attack now or after advancing
+};
+
+// Remembers the evaluation of pawn structures by pawn hash.
+// http://chessprogramming.wikispaces.com/Pawn+Hash+Table
+//
+// Entries are too big to share without locking, so every search thread has
+// its own table. Not thread safe.
+class PawnTable
+{
+public:
+    explicit PawnTable(size_t entryCount = 4096):entries(entryCount) {}
+
+    //Entry for key, which holds another pawn structure when its key differs.
+    //Empty entries hold the evaluation of no pawns at all, which has key 0.
+    PawnEntry& slot(T_hash key) { return entries[key & (entries.size() - 1)]; }
+
+private:
+    std::vector<PawnEntry> entries; //Size is a power of two
+};
+
+}
+
+#endif // PAWNTABLE_H
@@ -2,7 +2,17 @@
 #include <functional>
 #include <algorithm>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string.h>
 #include "chessboard.h"
+#include "bitboard.h"
+#include "transposition.h"
+#include "evalcache.h"
+#include "evalweights.h"
+#include "evalkernels.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -67,7 +77,7 @@ T_moves parseMoves(const char* movesStr)
     {
         Move mov;
         W_is >> mov;
-        ret.emplace_back(mov);
+        ret.push_back(mov);
         char c;
         W_is >> c;
     }
@@ -85,6 +95,42 @@ string checkFenIo(string fenIn)
     return "";
 }
 
+//Data stored for a key in the transposition table stress test, so any reader can verify it
+int ttTestScore(T_hash key) { return (int)(key >> 32) - (int)(key & 0xFFFF); }
+PackedMove ttTestMove(T_hash key) { return PackedMove(key >> 20 & 0x3F, key >> 26 & 0x3F); }
+int ttTestDepth(T_hash key) { return (int)(key >> 8 & 0x3F); }
+
+//Several threads store and probe the same buckets. Torn writes may cause a miss,
+//but a hit must always return the data that was stored for that key.
+int ttStressErrors(int threadCount, int iterations)
+{
+    TranspositionTable tt(1);
+    atomic<int> errors(0);
+    vector<thread> threads;
+    for(int t = 0; t < threadCount; ++t)
+        threads.emplace_back([&, t]
+        {
+            T_hash rnd = 0x2545F4914F6CDD1DULL * (t + 1);
+            for(int i = 0; i < iterations; ++i)
+            {
+                rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+                //Few distinct buckets, so threads write to the same slots all the time
+                T_hash key = (rnd & ~T_hash(0xFF)) | (rnd & 0x7);
+                TranspositionTable::Entry entry;
+                if(tt.probe(key, entry))
+                {
+                    if(entry.score != ttTestScore(key) || entry.move != ttTestMove(key) || entry.depth != ttTestDepth(key))
+                        ++errors;
+                }
+                else
+                    tt.store(key, ttTestScore(key), ttTestDepth(key), TranspositionTable::boundExact, ttTestMove(key));
+            }
+        });
+    for(auto &t:threads)
+        t.join();
+    return errors;
+}
+
 void test()
 {
     using namespace Chess;
@@ -98,6 +144,14 @@ void test()
                                "A2-A3,A2-A4,B2-B3,B2-B4,C2-C3,C2-C4,D2-D3,D2-D4,E2-E3,E2-E4,F2-F3,F2-F4,G2-G3,"
                                "G2-G4,H2-H3,H2-H4")), "");
 
+    //**** Test move list
+    MoveList moveList;
+    board->getMoves(moveList);
+    TEST_EQUAL(isSameMoves(moveList, board->getMoves()), "");
+    board->getMoves(Pos(1,0), moveList); //Knight on B1
+    TEST_EQUAL(isSameMoves(moveList, parseMoves("B1-C3,B1-A3")), "");
+    TEST_EXCEPTION([&]{ board->getMoves(Pos(1,7), moveList); }); //Not whites turn
+
     TEST_EXCEPTION([&]{ board->move("A2-A5"); });
     TEST_EXCEPTION([&]{ board->move("A2-A1"); });
     TEST_EXCEPTION([&]{ board->move("A2-A2"); });
@@ -245,6 +299,15 @@ void test()
     TEST_EQUAL(board->fen(),board2->fen());
     TEST_EQUAL(board->hash(),board2->hash());
 
+    // Side to move is part of the hash
+    board2->fen("1K6/8/8/8/8/8/8/k7 w");
+    TEST_ASSERT(board->hash() != board2->hash());
+
+    //**** Test options
+    board->setOption("Hash", 1);
+    TEST_EXCEPTION([&]{ board->setOption("Hash", 0); });
+    TEST_EXCEPTION([&]{ board->setOption("NoSuchOption", 1); });
+
     //**** Test evaluate
     board = makeChessBoard();
     board->fen("K7/8/8/8/8/8/8/k7 w");
@@ -263,6 +326,327 @@ void test()
     board->fen("k7/8/8/8/8/8/8/Q7 w");
     TEST_ASSERT(board->evaluate() < 200000);
 
+    //**** Test undo
+    board->fen(endFen);
+    board->move("F4xF6");
+    board->move("E7xF6");
+    board->undo();
+    board->undo();
+    TEST_EQUAL(board->fen(), endFen);
+    TEST_EQUAL(board->hash(), endHash);
+    board->undo(); //Undo loading the fen
+    TEST_EQUAL(board->fen(), "k7/8/8/8/8/8/8/Q7 w");
+
+    //**** Test incremental evaluation matches the evaluation of the same position loaded from fen
+    board->reset();
+    for(auto m:{"E2-E4", "D7-D5", "E4xD5", "D8xD5", "B1-C3", "D5xA2", "A1xA2"})
+        board->move(m);
+    int incremental = board->evaluate();
+    board->fen(board->fen().c_str());
+    TEST_EQUAL(board->evaluate(), incremental);
+    board->undo(); //Undo loading the fen
+    board->undo();
+    board->undo();
+    int afterUndo = board->evaluate();
+    board->fen(board->fen().c_str());
+    TEST_EQUAL(board->evaluate(), afterUndo);
+
+    //**** Test evaluation weights
+    board->reset();
+    TEST_EQUAL(board->evaluate(), 0); //Symmetric, so black's mirrored tables cancel white's
+    ostringstream weightsOut;
+    evalWeights.write(weightsOut);
+    EvalWeights readWeights;
+    readWeights.mobility = 0;
+    istringstream weightsIn(weightsOut.str());
+    readWeights.read(weightsIn);
+    TEST_ASSERT(memcmp(&readWeights, &evalWeights, sizeof(EvalWeights)) == 0);
+    TEST_EXCEPTION([&]{ istringstream is("# comment\nno_such_weight 1"); readWeights.read(is); });
+    TEST_EXCEPTION([&]{ istringstream is("passed_pawn 0 1 2"); readWeights.read(is); });
+
+    EvalWeights savedWeights = evalWeights;
+    istringstream noMaterial("material_mg 0 0 0 0 0 0 20000000\nmaterial_eg 0 0 0 0 0 0 20000000");
+    evalWeights.read(noMaterial);
+    board = makeChessBoard();
+    board->fen("k7/8/8/8/8/8/8/QQ5K w");
+    int withoutMaterial = board->evaluate();
+    evalWeights = savedWeights;
+    board = makeChessBoard();
+    board->fen("k7/8/8/8/8/8/8/QQ5K w");
+    TEST_ASSERT(board->evaluate() > withoutMaterial + 150);
+
+    //**** Test every set of evaluation kernels gives the same scores as the scalar reference
+    const EvalKernels* scalar = supportedEvalKernels().front();
+    const EvalKernels* defaultKernels = evalKernels;
+    TEST_EQUAL(string(scalar->name), "scalar");
+    T_bitboard bbs[19];
+    Piece kernelBoard[64];
+    T_hash rnd = 0x9E3779B97F4A7C15ULL;
+    for(int i = 0; i < 64; ++i)
+    {
+        rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+        if(i < 19)
+            bbs[i] = rnd;
+        int kind = rnd % 10; //Also empty squares of both colors
+        kernelBoard[i] = kind <= Piece::king ? Piece((rnd >> 8) & 1, Piece::Enum(kind)) : Piece(false);
+    }
+    const char* kernelFens[] = { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w", "4q3/1P2N3/1PN1K3/P3P1b1/4p1BP/3p2p1/ppp1nk1p/r6r w" };
+    for(auto kernels:supportedEvalKernels())
+    {
+        for(int count = 0; count <= 19; ++count)
+            TEST_EQUAL(kernels->popCountSum(bbs, count), scalar->popCountSum(bbs, count));
+        for(int ph = 0; ph < PHASES; ++ph)
+            TEST_EQUAL(kernels->pieceSquareSum(kernelBoard, evalWeights.pieceSquare[ph]),
+                       scalar->pieceSquareSum(kernelBoard, evalWeights.pieceSquare[ph]));
+        for(auto fen:kernelFens)
+        {
+            evalKernels = scalar;
+            board = makeChessBoard();
+            board->fen(fen);
+            int scalarScore = board->evaluate();
+            evalKernels = kernels;
+            board = makeChessBoard();
+            board->fen(fen);
+            TEST_EQUAL(board->evaluate(), scalarScore);
+        }
+    }
+    evalKernels = defaultKernels;
+
+    //**** Test perft
+    board->reset();
+    TEST_EQUAL(board->perft(1), 20u);
+    TEST_EQUAL(board->perft(2), 400u);
+    TEST_EQUAL(board->perft(3), 8902u);
+    uint64_t divideTotal = 0;
+    TEST_EQUAL(board->divide(3, [&](Move, uint64_t nodes){ divideTotal += nodes; }), 8902u);
+    TEST_EQUAL(divideTotal, 8902u);
+    board->fen("8/4P1P1/8/1R3p1k/KP5r/3p4/2p5/8 w");
+    TEST_EQUAL(board->perft(3), 2810u);
+
+    //**** Test legal move generation
+    board->fen("4K3/4B3/8/8/8/8/8/4r2k w"); //Bishop pinned to the king
+    TEST_EQUAL(board->getMoves(Pos(4,1)).size(), 0u);
+    board->fen("4K3/4R3/8/8/8/8/8/4r2k w"); //Rook pinned, but can move along the pin
+    TEST_EQUAL(isSameMoves(board->getMoves(Pos(4,1)), parseMoves("E2-E3,E2-E4,E2-E5,E2-E6,E2-E7,E2xE8")), "");
+    board->fen("4K1N1/8/8/8/8/8/8/4r2k w"); //Check: king steps aside or knight blocks
+    TEST_ASSERT(board->inCheck());
+    TEST_EQUAL(isSameMoves(board->getMoves(), parseMoves("E1-D1,E1-D2,E1-F1,E1-F2,G1-E2")), "");
+    TEST_EXCEPTION([&]{ board->move("G1-F3"); });
+
+    //**** Test mate and stalemate
+    board->fen("K7/1q6/2k5/8/8/8/8/8 w");
+    TEST_ASSERT(board->inCheck() && board->getMoves().empty()); //Mate
+    TEST_EXCEPTION([&]{ board->think([](Move, int, int){}, 2); });
+    board->fen("K7/2q5/8/8/8/8/8/7k w");
+    TEST_ASSERT(!board->inCheck() && board->getMoves().empty()); //Stalemate
+    board->fen("8/8/8/8/8/1K6/7Q/k7 w");
+    int mateScore = 0;
+    board->think([&](Move, int, int score){ mateScore = score; }, 1); //Mate in one
+    TEST_ASSERT(mateScore > 200000);
+
+    //**** Test search limits and thinking in the background
+    board->reset();
+    auto isLegal = [&](const Move& m)
+    {
+        for(auto &l:board->getMoves())
+            if(l.from == m.from && l.to == m.to)
+                return true;
+        return false;
+    };
+    SearchLimits limits;
+    limits.nodes = 20000;
+    board->think([](Move, int, int){}, limits);
+    TEST_ASSERT(board->searchStats().nodes < 30000);
+    limits = SearchLimits();
+    limits.moveTime = 50;
+    auto thinkStart = chrono::steady_clock::now();
+    board->startThink([](Move, int, int){}, limits);
+    while(board->thinking())
+        this_thread::sleep_for(chrono::milliseconds(1));
+    TEST_ASSERT(chrono::steady_clock::now() - thinkStart < chrono::seconds(1));
+    TEST_ASSERT(isLegal(board->stop()));
+    limits = SearchLimits(); //Until stopped
+    board->startThink([](Move, int, int){}, limits);
+    this_thread::sleep_for(chrono::milliseconds(20));
+    TEST_ASSERT(board->thinking());
+    TEST_ASSERT(isLegal(board->stop()));
+    TEST_ASSERT(!board->thinking());
+    limits.whiteTime = 500;
+    thinkStart = chrono::steady_clock::now();
+    board->think([](Move, int, int){}, limits);
+    TEST_ASSERT(chrono::steady_clock::now() - thinkStart < chrono::milliseconds(500));
+    board->fen("K7/1q6/2k5/8/8/8/8/8 w"); //Mate
+    board->startThink([](Move, int, int){}, limits);
+    TEST_EXCEPTION([&]{ board->stop(); });
+
+    //**** Test UCI
+    board = makeChessBoard();
+    TEST_EQUAL(ChessUci::toBoardFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"), board->fen());
+    TEST_EQUAL(ChessUci::toBoardFen("7k/8/8/8/8/8/8/K7 b - - 0 1"), "K7/8/8/8/8/8/8/7k b");
+    TEST_EXCEPTION([&]{ ChessUci::toBoardFen("8/8 w"); });
+    Move uciMove = ChessUci::parseMove("e2e4");
+    TEST_ASSERT(uciMove.from == Pos(4,1) && uciMove.to == Pos(4,3));
+    TEST_EQUAL(ChessUci::moveString(uciMove), "e2e4");
+    TEST_EXCEPTION([&]{ ChessUci::parseMove("e7e8q"); });
+    TEST_EXCEPTION([&]{ ChessUci::parseMove("i2e4"); });
+    istringstream uciIn("isready\n"
+                        "setoption name Hash value 8\n"
+                        "position fen 4k3/8/8/8/8/8/4P3/4K3 w - - 0 1 moves e2e4 e8d8\n"
+                        "go depth 3\n"
+                        "stop\n");
+    ostringstream uciOut;
+    ChessUci::run(board, uciIn, uciOut);
+    TEST_EQUAL(board->fen(), "4K3/8/8/4P3/8/8/8/3k4 w");
+    string uciAnswer = uciOut.str();
+    TEST_ASSERT(uciAnswer.find("uciok\n") != string::npos);
+    TEST_ASSERT(uciAnswer.find("readyok\n") != string::npos);
+    size_t bestMovePos = uciAnswer.find("bestmove ");
+    TEST_ASSERT(bestMovePos != string::npos && uciAnswer.find("Error") == string::npos);
+    TEST_ASSERT(isLegal(ChessUci::parseMove(uciAnswer.substr(bestMovePos + 9, 4))));
+
+    //**** Test parallel think finds the same move as single threaded
+    const char* parallelFen = "4q3/1P2N3/1PN1K3/P3P1b1/4p1BP/3p2p1/ppp1nk1p/r6r w";
+    Move singleBest;
+    board = makeChessBoard();
+    board->fen(parallelFen);
+    board->think([&](Move m, int, int){ singleBest = m; }, 3);
+    for(int ybwc = 0; ybwc < 2; ++ybwc)
+    {
+        board = makeChessBoard();
+        board->setOption("Threads", 4);
+        board->setOption("YBWC", ybwc);
+        board->fen(parallelFen);
+        Move best;
+        board->think([&](Move m, int, int){ best = m; }, 3);
+        TEST_ASSERT(best.from == singleBest.from && best.to == singleBest.to);
+        TEST_ASSERT(board->searchStats().nodes > 0);
+        TEST_ASSERT(board->searchStats().firstMoveCutoffs <= board->searchStats().cutoffs);
+    }
+
+    //**** Test move ordering gives most cutoffs on the first move
+    board = makeChessBoard();
+    board->think([](Move, int, int){}, 4);
+    TEST_ASSERT(board->searchStats().cutoffs > 0);
+    TEST_ASSERT(board->searchStats().firstMoveCutoffRate() > 60.0);
+
+    //**** Test selective search finds the same move with fewer nodes
+    uint64_t selectiveNodes[2];
+    for(int selective = 0; selective < 2; ++selective)
+    {
+        board = makeChessBoard();
+        board->setOption("NullMove", selective);
+        board->setOption("LMR", selective);
+        board->setOption("Futility", selective);
+        board->setOption("SEE", selective);
+        board->fen("4q3/1P2N3/1PN1K3/P3P1b1/4p1BP/3p2p1/ppp1nk1p/r6r w");
+        Move best;
+        board->think([&](Move m, int, int){ best = m; }, 4);
+        TEST_ASSERT(best.from == Pos(6,4) && best.to == Pos(4,6)); //G5xE7
+        selectiveNodes[selective] = board->searchStats().nodes;
+    }
+    TEST_ASSERT(selectiveNodes[1] < selectiveNodes[0]);
+
+    //**** Test static exchange evaluation
+    board->fen("K3Q3/8/8/4p3/3p4/8/8/7k w");
+    TEST_ASSERT(board->see(Move(Pos(4,0), Pos(4,3))) < 0); //E1xE4, pawn defended by pawn
+    board->fen("K3Q3/8/8/4p3/8/8/8/7k w");
+    TEST_EQUAL(board->see(Move(Pos(4,0), Pos(4,3))), evalWeights.material[middleGame][Piece::pawn]);
+    board->fen("K3R3/4R3/8/4n3/8/8/4r3/7k w"); //Rooks on E1, E2, knight E4, rook E7
+    TEST_ASSERT(board->see(Move(Pos(4,1), Pos(4,3))) > 0); //Second rook recaptures as x-ray
+    board->fen("K7/4R3/8/4n3/8/8/4r3/7k w");
+    TEST_ASSERT(board->see(Move(Pos(4,1), Pos(4,3))) < 0);
+
+    //**** Test quiescence search sees the recapture of a defended pawn
+    board->fen("K3Q3/8/8/4p3/3p4/8/8/7k w");
+    Move quietBest;
+    board->think([&](Move m, int, int){ quietBest = m; }, 0);
+    TEST_ASSERT(!(quietBest.from == Pos(4,0) && quietBest.to == Pos(4,3))); //Not E1xE4
+    TEST_ASSERT(board->searchStats().quiescenceNodes > 0);
+
+    //**** Test packed moves
+    board->fen("K3R3/4R3/8/4n3/8/8/4r3/7k w");
+    int packedCaptures = 0;
+    for(const Move& m:board->getMoves())
+    {
+        PackedMove packed(m);
+        TEST_ASSERT(packed.toMove().from == m.from && packed.toMove().to == m.to);
+        TEST_EQUAL(packed.capturing(), m.capturing());
+        packedCaptures += packed.capturing();
+    }
+    TEST_EQUAL(packedCaptures, 1); //E2xE4
+    TEST_EQUAL(PackedMove(63, 62, PackedMove::flagCapture).from(), 63);
+    TEST_EQUAL(PackedMove(63, 62, PackedMove::flagCapture).to(), 62);
+    TEST_ASSERT(PackedMove().isNull());
+
+    //**** Test transposition table
+    TranspositionTable tt(1);
+    TranspositionTable::Entry entry;
+    TEST_ASSERT(!tt.probe(12345, entry));
+    tt.store(12345, -77, 5, TranspositionTable::boundLower, PackedMove(8, 24));
+    TEST_ASSERT(tt.probe(12345, entry));
+    TEST_EQUAL(entry.score, -77);
+    TEST_EQUAL((int)entry.depth, 5);
+    TEST_EQUAL((int)entry.bound, (int)TranspositionTable::boundLower);
+    TEST_EQUAL(entry.move.to(), 24);
+    tt.store(12345, 10, 3, TranspositionTable::boundExact, PackedMove()); //Shallower, ignored
+    TEST_ASSERT(tt.probe(12345, entry) && entry.score == -77);
+    TEST_ASSERT(!tt.probe(12345 + (T_hash(1) << 40), entry)); //Same bucket, other key
+    TEST_EQUAL(ttStressErrors(4, 200000), 0);
+
+    //**** Test evaluation cache
+    EvalCache evalCache(1);
+    int cachedScore = 0;
+    TEST_ASSERT(!evalCache.probe(12345, cachedScore));
+    evalCache.store(12345, -77);
+    TEST_ASSERT(evalCache.probe(12345, cachedScore) && cachedScore == -77);
+    TEST_ASSERT(!evalCache.probe(12345 + (T_hash(1) << 40), cachedScore)); //Same slot, other key
+    TEST_ASSERT(!evalCache.probe(54321, cachedScore)); //Empty slot
+    evalCache.resize(0);
+    evalCache.store(12345, -77);
+    TEST_ASSERT(!evalCache.probe(12345, cachedScore));
+
+    for(int cacheSize = 0; cacheSize < 2; ++cacheSize)
+    {
+        board = makeChessBoard();
+        board->setOption("EvalCache", cacheSize);
+        board->think([](Move, int, int){}, 3);
+        TEST_ASSERT(board->searchStats().evalProbes > 0);
+        TEST_EQUAL(board->searchStats().evalHits > 0, cacheSize > 0);
+        TEST_ASSERT(board->searchStats().pawnHits > 0);
+        TEST_ASSERT(board->searchStats().pawnHits <= board->searchStats().pawnProbes);
+    }
+
+    //**** Test bitboard helpers
+    T_bitboard bb = bit(0) | bit(9) | bit(63);
+    TEST_EQUAL(popCount(bb), 3);
+    TEST_EQUAL(popLsb(bb), 0);
+    TEST_EQUAL(popLsb(bb), 9);
+    TEST_EQUAL(bitScan(bb), 63);
+    TEST_EQUAL(popCount(knightAttacks[0]), 2);
+    TEST_EQUAL(popCount(kingAttacks[27]), 8);
+    TEST_EQUAL(pawnAttacks[true][8], bit(17));
+    TEST_EQUAL(pawnAttacks[false][17], bit(8) | bit(10));
+    TEST_EQUAL(adjacentFiles(8), fileOf(1));
+    TEST_EQUAL(adjacentFiles(3), fileOf(2) | fileOf(4));
+    TEST_EQUAL(forwardRanks(true, 8), 0xFFFFFFFFFFFF0000ULL);
+    TEST_EQUAL(forwardRanks(false, 8), 0xFFULL);
+    TEST_EQUAL(forwardRanks(true, 60), 0ULL);
+    TEST_EQUAL(forwardRanks(false, 3), 0ULL);
+
+    //**** Test sliding attack tables against ray walking
+    T_bitboard occ = 0x5A3C00F0810024E1ULL;
+    for(int i = 0; i < 200; ++i)
+    {
+        occ ^= occ << 13; occ ^= occ >> 7; occ ^= occ << 17;
+        T_bitboard sparseOcc = occ & (occ >> 3);
+        for(int ix = 0; ix < 64; ix += 3)
+        {
+            TEST_EQUAL(rookAttacks(ix, sparseOcc), rookAttacksByRays(ix, sparseOcc));
+            TEST_EQUAL(bishopAttacks(ix, occ), bishopAttacksByRays(ix, occ));
+        }
+    }
+    TEST_EQUAL(rookAttacks(0, 0), 0x01010101010101FEULL);
+
 //  cout << board->fen() << endl;
 //  board->print(cout);
 }
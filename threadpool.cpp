@@ -0,0 +1,103 @@
+#include "threadpool.h"
+#include <chrono>
+
+using namespace std;
+
+namespace Chess
+{
+
+namespace
+{
+thread_local int workerIndex = 0;
+}
+
+WorkStealingPool::WorkStealingPool(int helperCount):pending(0),quit(false)
+{
+    for(int i = 0; i <= helperCount; ++i)
+        queues.emplace_back(new Queue());
+    for(int i = 1; i <= helperCount; ++i)
+        threads.emplace_back([this, i]{ workerLoop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        lock_guard<mutex> lock(idleMutex);
+        quit = true;
+    }
+    idle.notify_all();
+    for(auto &i:threads)
+        i.join();
+}
+
+int WorkStealingPool::currentWorker()
+{
+    return workerIndex;
+}
+
+void WorkStealingPool::push(T_task task)
+{
+    Queue& queue = *queues[workerIndex < (int)queues.size() ? workerIndex : 0];
+    {
+        lock_guard<mutex> lock(queue.mutex);
+        queue.tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> lock(idleMutex);
+        ++pending;
+    }
+    idle.notify_one();
+}
+
+bool WorkStealingPool::takeTask(T_task& task)
+{
+    int self = workerIndex < (int)queues.size() ? workerIndex : 0;
+    {
+        Queue& own = *queues[self];
+        lock_guard<mutex> lock(own.mutex);
+        if(!own.tasks.empty())
+        {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            --pending;
+            return true;
+        }
+    }
+    for(size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> lock(victim.mutex);
+        if(!victim.tasks.empty())
+        {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::runPendingTask()
+{
+    T_task task;
+    if(!takeTask(task))
+        return false;
+    task();
+    return true;
+}
+
+void WorkStealingPool::workerLoop(int index)
+{
+    workerIndex = index;
+    while(!quit)
+    {
+        if(runPendingTask())
+            continue;
+        unique_lock<mutex> lock(idleMutex);
+        idle.wait_for(lock, chrono::milliseconds(10), [this]{ return quit || pending > 0; });
+    }
+    workerIndex = 0;
+}
+
+}//namespace Chess
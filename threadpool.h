@@ -0,0 +1,59 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+namespace Chess
+{
+
+// Thread pool where every participating thread has its own task deque.
+// A thread takes the newest task of its own deque first (depth first, like the
+// sequential search would), and steals the oldest task of another deque when
+// its own is empty. The thread that creates the pool participates as worker 0
+// by calling runPendingTask while it waits for its tasks.
+// http://chessprogramming.wikispaces.com/Work-Stealing
+class WorkStealingPool
+{
+public:
+    typedef std::function<void()> T_task;
+
+    //Starts helperCount threads next to the calling thread
+    explicit WorkStealingPool(int helperCount);
+    ~WorkStealingPool();
+
+    //Queues a task on the deque of the calling thread
+    void push(T_task task);
+    //Runs one queued task, own ones first. Returns false if there was none.
+    bool runPendingTask();
+
+    //Index of the calling worker thread in the pool that runs it, 0 for other threads
+    static int currentWorker();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<T_task> tasks;
+    };
+
+    bool takeTask(T_task& task);
+    void workerLoop(int index);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> pending;
+    std::atomic<bool> quit;
+    std::mutex idleMutex;
+    std::condition_variable idle;
+};
+
+}
+
+#endif // THREADPOOL_H
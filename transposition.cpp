@@ -0,0 +1,75 @@
+#include "transposition.h"
+#include <new>
+
+using namespace std;
+
+namespace Chess
+{
+
+void TranspositionTable::resize(size_t megaBytes)
+{
+    size_t count = 1;
+    while(count * 2 * sizeof(Bucket) <= megaBytes * 1024 * 1024)
+        count *= 2;
+
+    buckets = nullptr;
+    memory.reset(); //Release the old table before allocating the new one
+    memory.reset(new char[count * sizeof(Bucket) + alignof(Bucket)]);
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(memory.get()) + alignof(Bucket) - 1) & ~uintptr_t(alignof(Bucket) - 1);
+    buckets = reinterpret_cast<Bucket*>(aligned);
+    bucketCount = count;
+    for(size_t i = 0; i < bucketCount; ++i)
+        new (&buckets[i]) Bucket();
+    clear();
+}
+
+void TranspositionTable::clear()
+{
+    for(size_t i = 0; i < bucketCount; ++i)
+        for(auto &slot:buckets[i].slots)
+        {
+            slot.keyXorData.store(0, memory_order_relaxed);
+            slot.data.store(0, memory_order_relaxed);
+        }
+    generation = 0;
+}
+
+void TranspositionTable::store(T_hash key, int score, int depth, Bound bound, PackedMove move)
+{
+    Bucket& bucket = buckets[key & (bucketCount - 1)];
+
+    //Use the slot of this position if there is one. Otherwise replace an
+    //empty slot, else one from an older search, else the shallowest one.
+    Slot* victim = nullptr;
+    int victimValue = 0;
+    for(auto &slot:bucket.slots)
+    {
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        if((slot.keyXorData.load(memory_order_relaxed) ^ data) == key && dataBound(data) != boundNone)
+        {
+            //Keep a deeper result of this search
+            if(dataGeneration(data) == generation && (int8_t)(data >> 48) > depth)
+                return;
+            victim = &slot;
+            break;
+        }
+        int value = dataBound(data) == boundNone ? -1000 : (int8_t)(data >> 48);
+        if(dataGeneration(data) != generation)
+            value -= 256;
+        if(!victim || value < victimValue)
+        {
+            victim = &slot;
+            victimValue = value;
+        }
+    }
+
+    uint64_t data = (uint64_t)(uint32_t)score
+                  | (uint64_t)move.data << 32
+                  | (uint64_t)(uint8_t)depth << 48
+                  | (uint64_t)bound << 56
+                  | (uint64_t)generation << 58;
+    victim->keyXorData.store(key ^ data, memory_order_relaxed);
+    victim->data.store(data, memory_order_relaxed);
+}
+
+}//namespace Chess
@@ -0,0 +1,94 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "chessboard.h"
+
+namespace Chess
+{
+
+// Remembers search results by position hash, so positions reached through
+// different move orders are only searched once.
+// http://chessprogramming.wikispaces.com/Transposition+Table
+//
+// The table can be shared by several search threads without locking. Each
+// slot is two 64-bit words: the data and the key xor-ed with the data. A
+// probe only accepts a slot when both words belong to the same store, so a
+// write torn by another thread reads as a miss instead of as garbage.
+// http://www.cis.uab.edu/hyatt/hashing.html
+class TranspositionTable
+{
+public:
+    //What the stored score says about the real score
+    enum Bound { boundNone, boundUpper, boundLower, boundExact };
+
+    struct Entry
+    {
+        T_hash   key;
+        int32_t  score;
+        PackedMove move; //Best move, null if none
+        int8_t   depth;
+        uint8_t  bound;
+    };
+
+    explicit TranspositionTable(size_t megaBytes = 16) { resize(megaBytes); }
+
+    //Bucket count is rounded down to a power of two. Not thread safe.
+    void resize(size_t megaBytes);
+    //Not thread safe.
+    void clear();
+    //Call at the start of each search, so older entries get replaced first
+    void newSearch() { generation = (generation + 1) & GENERATION_MASK; }
+
+    size_t sizeMB() const { return bucketCount * sizeof(Bucket) / (1024 * 1024); }
+
+    bool probe(T_hash key, Entry& entry) const
+    {
+        const Bucket& bucket = buckets[key & (bucketCount - 1)];
+        for(auto &slot:bucket.slots)
+        {
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if((slot.keyXorData.load(std::memory_order_relaxed) ^ data) != key || dataBound(data) == boundNone)
+                continue;
+            entry.key   = key;
+            entry.score = (int32_t)(uint32_t)data;
+            entry.move  = PackedMove::fromData((uint16_t)(data >> 32));
+            entry.depth = (int8_t)(data >> 48);
+            entry.bound = dataBound(data);
+            return true;
+        }
+        return false;
+    }
+
+    void store(T_hash key, int score, int depth, Bound bound, PackedMove move);
+
+private:
+    // data layout: score 0..31, move 32..47, depth 48..55, bound 56..57, generation 58..63
+    static const unsigned GENERATION_MASK = 0x3F;
+    static uint8_t  dataBound(uint64_t data)      { return (uint8_t)(data >> 56 & 3); }
+    static unsigned dataGeneration(uint64_t data) { return (unsigned)(data >> 58); }
+
+    struct Slot
+    {
+        std::atomic<uint64_t> keyXorData;
+        std::atomic<uint64_t> data;
+    };
+
+    //One cache line
+    struct alignas(64) Bucket
+    {
+        Slot slots[4];
+    };
+
+    std::unique_ptr<char[]> memory; //Buckets are aligned inside this
+    Bucket*  buckets = nullptr;
+    size_t   bucketCount = 0;
+    unsigned generation = 0;
+};
+
+}
+
+#endif // TRANSPOSITION_H
@@ -0,0 +1,332 @@
+#include "uci.h"
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace std;
+using namespace std::chrono;
+using namespace Chess;
+
+namespace ChessUci
+{
+
+namespace
+{
+
+//How often the input loop checks whether a search reached its limits
+const milliseconds POLL_INTERVAL(5);
+
+const int DEFAULT_HASH_MB = 16;
+const int MAX_HASH_MB = 4096;
+const int MAX_THREADS = 64;
+
+// Reads the input in its own thread, so the engine keeps answering while it
+// thinks, and notices when a search ends by itself.
+class InputReader
+{
+public:
+    explicit InputReader(istream& in):reader([this, &in]{ read(in); }){}
+    ~InputReader() { reader.join(); }
+
+    //Waits at most timeout for the next line. Returns false if there is none yet.
+    bool next(string& line, milliseconds timeout)
+    {
+        unique_lock<mutex> lock(linesMutex);
+        if(!lineAdded.wait_for(lock, timeout, [this]{ return !lines.empty(); }))
+            return false;
+        line = lines.front();
+        lines.pop_front();
+        return true;
+    }
+
+private:
+    //Ends after quit, so the thread can be joined without waiting for more input
+    void read(istream& in)
+    {
+        string line;
+        while(getline(in, line))
+        {
+            push(line);
+            string command;
+            istringstream(line) >> command;
+            if(command == "quit")
+                return;
+        }
+        push("quit");
+    }
+
+    void push(const string& line)
+    {
+        lock_guard<mutex> lock(linesMutex);
+        lines.push_back(line);
+        lineAdded.notify_one();
+    }
+
+    mutex linesMutex;
+    condition_variable lineAdded;
+    deque<string> lines;
+    thread reader; //Last, so the rest is constructed when it starts
+};
+
+// Writes whole lines. The search thread sends info lines while the input
+// loop answers commands.
+class Output
+{
+public:
+    explicit Output(ostream& os_):os(os_){}
+
+    void send(const string& line)
+    {
+        lock_guard<mutex> lock(outMutex);
+        os << line << endl;
+    }
+
+private:
+    ostream& os;
+    mutex outMutex;
+};
+
+//Scores of think are doubled, and a pawn is 10.
+//depth is the iteration that found the score.
+string scoreString(int score, int depth)
+{
+    ostringstream os;
+    if(abs(score) > MATE_SCORE)
+        //The distance to mate is not known, the iteration bounds it
+        os << "mate " << (score > 0 ? 1 : -1) * (depth + 2) / 2;
+    else
+        os << "cp " << score * 5;
+    return os.str();
+}
+
+struct Command
+{
+    string command;
+    function<void(istream& params)> exec;
+};
+
+class Engine
+{
+public:
+    Engine(PChessBoard board_, ostream& out_):board(board_),out(out_),searching(false),infinite(false),quit(false){}
+
+    void run(istream& in)
+    {
+        Command cmd[] = {
+            { "uci",        [&](istream&){ identify(); } },
+            { "isready",    [&](istream&){ out.send("readyok"); } },
+            { "ucinewgame", [&](istream&){ stopSearch(); board->reset(); board->clearUndo(); } },
+            { "position",   [&](istream& params){ stopSearch(); position(params); } },
+            { "go",         [&](istream& params){ stopSearch(); go(params); } },
+            { "stop",       [&](istream&){ stopSearch(); } },
+            { "setoption",  [&](istream& params){ setOption(params); } },
+            { "quit",       [&](istream&){ quit = true; } }
+        };
+
+        identify();
+        InputReader input(in);
+        while(!quit)
+        {
+            string line;
+            if(input.next(line, POLL_INTERVAL))
+            {
+                istringstream params(line);
+                string command;
+                params >> command;
+                try
+                {
+                    //Unknown commands are ignored, as the protocol asks
+                    for(auto &i:cmd)
+                        if(command == i.command)
+                            i.exec(params);
+                }
+                catch(exception& e)
+                {
+                    out.send(string("info string Error: ") + e.what());
+                }
+            }
+            if(searching && !infinite && !board->thinking())
+                sendBestMove();
+        }
+        if(searching)
+        {
+            try
+            {
+                board->stop();
+            }
+            catch(runtime_error&) {} //No move, no one to tell anymore
+        }
+    }
+
+private:
+    void identify()
+    {
+        ostringstream options;
+        out.send("id name Chess");
+        out.send("id author Jopie64");
+        options << "option name Hash type spin default " << DEFAULT_HASH_MB << " min 1 max " << MAX_HASH_MB;
+        out.send(options.str());
+        options.str("");
+        options << "option name Threads type spin default 1 min 1 max " << MAX_THREADS;
+        out.send(options.str());
+        out.send("uciok");
+    }
+
+    //position [startpos | fen <fen>] [moves <move> ...]
+    void position(istream& params)
+    {
+        string token;
+        params >> token;
+        if(token == "startpos")
+        {
+            board->reset();
+            params >> token;
+        }
+        else if(token == "fen")
+        {
+            string fen;
+            while(params >> token && token != "moves")
+                fen += token + " ";
+            board->fen(toBoardFen(fen).c_str());
+        }
+        else
+            throw runtime_error("startpos or fen expected");
+        board->clearUndo(); //A GUI sends the whole game for every move
+        if(token == "moves")
+            while(params >> token)
+                board->move(parseMove(token));
+    }
+
+    void go(istream& params)
+    {
+        SearchLimits limits;
+        infinite = false;
+        string token;
+        while(params >> token)
+        {
+            if(token == "wtime")          params >> limits.whiteTime;
+            else if(token == "btime")     params >> limits.blackTime;
+            else if(token == "winc")      params >> limits.whiteIncrement;
+            else if(token == "binc")      params >> limits.blackIncrement;
+            else if(token == "movestogo") params >> limits.movesToGo;
+            else if(token == "nodes")     params >> limits.nodes;
+            else if(token == "movetime")  params >> limits.moveTime;
+            else if(token == "infinite")  infinite = true;
+            else if(token == "depth")
+            {
+                //The iterations of think count the plies after the root move
+                params >> limits.depth;
+                limits.depth = max(0, limits.depth - 1);
+            }
+        }
+        steady_clock::time_point start = steady_clock::now();
+        board->startThink([this, start](Move m, int depth, int score)
+        {
+            uint64_t nodes = board->thinkNodes();
+            int64_t ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+            ostringstream info;
+            info << "info depth " << depth + 1 << " score " << scoreString(score, depth) << " nodes " << nodes
+                 << " nps " << nodes * 1000 / max<int64_t>(ms, 1) << " time " << ms << " pv";
+            for(auto &pvMove:board->principalVariation(m))
+                info << ' ' << moveString(pvMove);
+            out.send(info.str());
+        }, limits);
+        searching = true;
+    }
+
+    //setoption name <name> value <value>
+    void setOption(istream& params)
+    {
+        if(searching)
+            throw runtime_error("Options can't be changed while thinking");
+        string token, name;
+        int value = 0;
+        params >> token;
+        while(params >> token && token != "value")
+            name += (name.empty() ? "" : " ") + token;
+        if(!(params >> value))
+            throw runtime_error("Option value expected");
+        board->setOption(name, value);
+    }
+
+    void stopSearch()
+    {
+        if(searching)
+            sendBestMove();
+    }
+
+    void sendBestMove()
+    {
+        searching = false;
+        string best;
+        try
+        {
+            best = moveString(board->stop());
+        }
+        catch(runtime_error&)
+        {
+            best = "0000"; //Mate or stalemate
+        }
+        out.send("bestmove " + best);
+    }
+
+    PChessBoard board;
+    Output out;
+    bool searching; //Started by go, bestmove not sent yet
+    bool infinite;  //Send bestmove only after stop
+    bool quit;
+};
+
+}//namespace
+
+string toBoardFen(const string& fen)
+{
+    istringstream is(fen);
+    string placement, side;
+    is >> placement >> side;
+    vector<string> ranks(1);
+    for(char c:placement)
+        if(c == '/')
+            ranks.emplace_back();
+        else
+            ranks.back() += c;
+    if(ranks.size() != 8)
+        throw runtime_error("FEN with 8 ranks expected: " + fen);
+    string boardFen;
+    for(auto rank = ranks.rbegin(); rank != ranks.rend(); ++rank)
+        boardFen += (boardFen.empty() ? "" : "/") + *rank;
+    return boardFen + (side == "b" ? " b" : " w");
+}
+
+Move parseMove(const string& s)
+{
+    if(s.size() == 5)
+        throw runtime_error("Promotion is not supported: " + s);
+    if(s.size() != 4 || s[0] < 'a' || s[0] > 'h' || s[1] < '1' || s[1] > '8' || s[2] < 'a' || s[2] > 'h' || s[3] < '1' || s[3] > '8')
+        throw runtime_error("Not a valid move: " + s);
+    return Move(Pos(s[0] - 'a', s[1] - '1'), Pos(s[2] - 'a', s[3] - '1'));
+}
+
+string moveString(const Move& m)
+{
+    string s;
+    s += char('a' + m.from.x);
+    s += char('1' + m.from.y);
+    s += char('a' + m.to.x);
+    s += char('1' + m.to.y);
+    return s;
+}
+
+void run(PChessBoard board, istream& in, ostream& out)
+{
+    Engine(board, out).run(in);
+}
+
+}//namespace ChessUci
@@ -0,0 +1,29 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include <string>
+#include <iostream>
+#include "chessboard.h"
+
+// Universal Chess Interface, the protocol chess GUIs and tournament managers
+// use to talk to engines.
+// http://wbec-ridderkerk.nl/html/UCIProtocol.html
+namespace ChessUci
+{
+
+//Standard FEN, which has the last rank first, to the FEN of ChessBoard: first
+//rank first, and only the side to move after the pieces. Castling, en passant
+//and the move counters are dropped, the board doesn't know them.
+std::string toBoardFen(const std::string& fen);
+
+//Long algebraic notation, like e2e4. Throws on promotions, the board has none.
+Chess::Move parseMove(const std::string& s);
+std::string moveString(const Chess::Move& m);
+
+//Answers as if uci was just received, as that is how a GUI switches to this
+//mode. Then handles commands from in until quit or the end of the input.
+void run(Chess::PChessBoard board, std::istream& in, std::ostream& out);
+
+}
+
+#endif // UCI_H